@@ -41,7 +41,7 @@ class TraceService : Service() {
             Log.d(TAG, "$path: $event")
             val name = path ?: return
 
-            if (CLOSE_WRITE == event && name.startsWith("trace-") && name.endsWith(".txt")) {
+            if (CLOSE_WRITE == event && name.startsWith("trace-") && (name.endsWith(".txt") || name.endsWith(".txt.gz"))) {
                 val trace = File(filesDir, name)
                 val uri = FileProvider.getUriForFile(this@TraceService, "$packageName.file", trace)
                 val mimeType = MimeTypeMap.getSingleton().getMimeTypeFromExtension(trace.extension)
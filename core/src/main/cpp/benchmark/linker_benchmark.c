@@ -0,0 +1,494 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "linker.h"
+
+/**
+ * Benchmark of <code>shared_library_open</code> and <code>shared_library_lookup</code> against synthetic
+ * shared objects, the result of each case is printed as a line of JSON:
+ *
+ * <pre>
+ * linker_benchmark [directory] [max symbols]
+ * </pre>
+ */
+
+#define BENCH_NAME_FMT    "bench_symbol_%08" PRIx32
+#define BENCH_MISS_FMT    "bench_missed_%08" PRIx32
+#define BENCH_NAME_SIZE   sizeof("bench_symbol_00000000")
+#define BENCH_TEXT_ADDR   0x1000
+#define BENCH_FUNC_SIZE   16
+#define BENCH_OPENS       5
+#define BENCH_QUERIES     1024
+#define BENCH_MAX_LOOKUPS 100000
+#define BENCH_BUDGET_NS   200000000L
+
+enum {
+    SEC_NULL,
+    SEC_TEXT,
+    SEC_DYNSTR,
+    SEC_DYNSYM,
+    SEC_HASH,
+    SEC_STRTAB,
+    SEC_SYMTAB,
+    SEC_SHSTRTAB,
+    SEC_COUNT,
+};
+
+static const char SHSTRTAB[] = "\0.text\0.dynstr\0.dynsym\0.gnu.hash\0.hash\0.strtab\0.symtab\0.shstrtab";
+
+typedef struct bench_case {
+    size_t nsyms;
+    uint32_t hash;
+    int symtab;
+} bench_case_t;
+
+typedef struct bench_result {
+    size_t file_size;
+    uint64_t open_ns;
+    uint64_t hit_ns;
+    uint64_t miss_ns;
+    long rss_kb;
+    long minflt;
+    long majflt;
+} bench_result_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000UL + (uint64_t) ts.tv_nsec;
+}
+
+static long get_rss_kb(void) {
+    long size = 0;
+    long resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+
+    if (NULL != statm) {
+        if (2 != fscanf(statm, "%ld %ld", &size, &resident)) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static uint32_t gnu_hash(const char* name) {
+    uint32_t h = 5381;
+    for (const uint8_t* c = (const uint8_t*) name; *c != '\0'; c++) {
+        h += (h << 5) + *c;
+    }
+    return h;
+}
+
+static uint32_t sysv_hash(const char* name) {
+    uint32_t h = 0;
+    uint32_t g;
+    for (const uint8_t* c = (const uint8_t*) name; *c != '\0'; c++) {
+        h = (h << 4) + *c;
+        g = h & 0xf0000000;
+        h ^= g;
+        h ^= g >> 24;
+    }
+    return h;
+}
+
+static size_t align8(size_t x) {
+    return (x + 7) & ~((size_t) 7);
+}
+
+static int write_at(int fd, const void* data, size_t size, size_t* offset) {
+    const uint8_t* ptr = data;
+    size_t n = 0;
+    ssize_t rc;
+
+    *offset = align8(*offset);
+    while (n < size) {
+        if (0 >= (rc = pwrite(fd, ptr + n, size - n, (off_t) (*offset + n)))) {
+            return -1;
+        }
+        n += (size_t) rc;
+    }
+    *offset += size;
+    return 0;
+}
+
+static ElfW(Word) shstrtab_offset(const char* name) {
+    for (size_t i = 1; i < sizeof(SHSTRTAB); i += strlen(SHSTRTAB + i) + 1) {
+        if (0 == strcmp(SHSTRTAB + i, name)) {
+            return (ElfW(Word)) i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Generate the symbol tables of a shared object, the code is never loaded
+ */
+static int generate(const char* path, const bench_case_t* c, size_t* file_size) {
+    ElfW(Ehdr) ehdr;
+    ElfW(Phdr) phdr;
+    ElfW(Shdr) shdrs[SEC_COUNT];
+    size_t nsyms = c->nsyms + 1;
+    size_t nbuckets = c->nsyms / 4 + 1;
+    size_t bloom_size = 1;
+    size_t offset = sizeof(ehdr) + sizeof(phdr);
+    size_t str_size = 1 + c->nsyms * BENCH_NAME_SIZE;
+    size_t hash_size = 0;
+    char* str = NULL;
+    ElfW(Sym)* syms = NULL;
+    uint32_t* hashes = NULL;
+    size_t* order = NULL;
+    uint32_t* hash = NULL;
+    int rc = -1;
+    int fd;
+
+    if (0 > (fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600))) {
+        return -1;
+    }
+
+    while (bloom_size * 16 < c->nsyms) {
+        bloom_size <<= 1;
+    }
+
+    if (NULL == (str = calloc(str_size, 1))
+            || NULL == (syms = calloc(nsyms, sizeof(ElfW(Sym))))
+            || NULL == (hashes = calloc(nsyms, sizeof(uint32_t)))
+            || NULL == (order = calloc(nsyms, sizeof(size_t)))) {
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < c->nsyms; i++) {
+        snprintf(str + 1 + i * BENCH_NAME_SIZE, BENCH_NAME_SIZE, BENCH_NAME_FMT, (uint32_t) i);
+        hashes[i] = gnu_hash(str + 1 + i * BENCH_NAME_SIZE);
+    }
+
+    // .gnu.hash requires the symbols sorted by bucket
+    if (SHT_GNU_HASH == c->hash) {
+        size_t* counts = calloc(nbuckets + 1, sizeof(size_t));
+        if (NULL == counts) {
+            goto cleanup;
+        }
+        for (size_t i = 0; i < c->nsyms; i++) {
+            counts[hashes[i] % nbuckets + 1]++;
+        }
+        for (size_t b = 0; b < nbuckets; b++) {
+            counts[b + 1] += counts[b];
+        }
+        for (size_t i = 0; i < c->nsyms; i++) {
+            order[counts[hashes[i] % nbuckets]++] = i;
+        }
+        free(counts);
+    } else {
+        for (size_t i = 0; i < c->nsyms; i++) {
+            order[i] = i;
+        }
+    }
+
+    for (size_t i = 0; i < c->nsyms; i++) {
+        ElfW(Sym)* sym = &syms[i + 1];
+        sym->st_name = (ElfW(Word)) (1 + order[i] * BENCH_NAME_SIZE);
+        sym->st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+        sym->st_shndx = SEC_TEXT;
+        sym->st_value = BENCH_TEXT_ADDR + order[i] * BENCH_FUNC_SIZE;
+        sym->st_size = BENCH_FUNC_SIZE;
+    }
+
+    if (SHT_GNU_HASH == c->hash) {
+        const size_t bits = sizeof(ElfW(Addr)) * 8;
+        ElfW(Addr)* bloom;
+        uint32_t* buckets;
+        uint32_t* chain;
+
+        hash_size = 4 * sizeof(uint32_t) + bloom_size * sizeof(ElfW(Addr)) + (nbuckets + c->nsyms) * sizeof(uint32_t);
+        if (NULL == (hash = calloc(hash_size, 1))) {
+            goto cleanup;
+        }
+
+        hash[0] = (uint32_t) nbuckets;
+        hash[1] = 1;
+        hash[2] = (uint32_t) bloom_size;
+        hash[3] = 6;
+        bloom = (void*) &hash[4];
+        buckets = (void*) &bloom[bloom_size];
+        chain = &buckets[nbuckets];
+
+        for (size_t i = 0; i < c->nsyms; i++) {
+            uint32_t h = hashes[order[i]];
+            uint32_t b = (uint32_t) (h % nbuckets);
+
+            bloom[(h / bits) % bloom_size] |= ((ElfW(Addr)) 1 << (h % bits)) | ((ElfW(Addr)) 1 << ((h >> 6) % bits));
+            if (0 == buckets[b]) {
+                buckets[b] = (uint32_t) (i + 1);
+            }
+            chain[i] = h & ~1U;
+            if (i + 1 == c->nsyms || hashes[order[i + 1]] % nbuckets != b) {
+                chain[i] |= 1;
+            }
+        }
+    } else if (SHT_HASH == c->hash) {
+        uint32_t* bucket;
+        uint32_t* chain;
+
+        hash_size = (2 + nbuckets + nsyms) * sizeof(uint32_t);
+        if (NULL == (hash = calloc(hash_size, 1))) {
+            goto cleanup;
+        }
+
+        hash[0] = (uint32_t) nbuckets;
+        hash[1] = (uint32_t) nsyms;
+        bucket = &hash[2];
+        chain = &bucket[nbuckets];
+
+        for (size_t i = 1; i < nsyms; i++) {
+            uint32_t b = sysv_hash(str + syms[i].st_name) % (uint32_t) nbuckets;
+            chain[i] = bucket[b];
+            bucket[b] = (uint32_t) i;
+        }
+    }
+
+    memset(shdrs, 0, sizeof(shdrs));
+
+    shdrs[SEC_TEXT].sh_name = shstrtab_offset(".text");
+    shdrs[SEC_TEXT].sh_type = SHT_NOBITS;
+    shdrs[SEC_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    shdrs[SEC_TEXT].sh_addr = BENCH_TEXT_ADDR;
+    shdrs[SEC_TEXT].sh_size = c->nsyms * BENCH_FUNC_SIZE;
+
+    shdrs[SEC_DYNSTR].sh_name = shstrtab_offset(".dynstr");
+    shdrs[SEC_DYNSTR].sh_type = SHT_STRTAB;
+    shdrs[SEC_DYNSTR].sh_size = str_size;
+    if (0 != write_at(fd, str, str_size, &offset)) {
+        goto cleanup;
+    }
+    shdrs[SEC_DYNSTR].sh_offset = offset - str_size;
+
+    shdrs[SEC_DYNSYM].sh_name = shstrtab_offset(".dynsym");
+    shdrs[SEC_DYNSYM].sh_type = SHT_DYNSYM;
+    shdrs[SEC_DYNSYM].sh_link = SEC_DYNSTR;
+    shdrs[SEC_DYNSYM].sh_info = 1;
+    shdrs[SEC_DYNSYM].sh_entsize = sizeof(ElfW(Sym));
+    shdrs[SEC_DYNSYM].sh_size = nsyms * sizeof(ElfW(Sym));
+    if (0 != write_at(fd, syms, nsyms * sizeof(ElfW(Sym)), &offset)) {
+        goto cleanup;
+    }
+    shdrs[SEC_DYNSYM].sh_offset = offset - shdrs[SEC_DYNSYM].sh_size;
+
+    if (NULL != hash) {
+        shdrs[SEC_HASH].sh_name = shstrtab_offset(SHT_GNU_HASH == c->hash ? ".gnu.hash" : ".hash");
+        shdrs[SEC_HASH].sh_type = c->hash;
+        shdrs[SEC_HASH].sh_link = SEC_DYNSYM;
+        shdrs[SEC_HASH].sh_size = hash_size;
+        if (0 != write_at(fd, hash, hash_size, &offset)) {
+            goto cleanup;
+        }
+        shdrs[SEC_HASH].sh_offset = offset - hash_size;
+    }
+
+    // an unstripped library has the exported symbols in .symtab as well
+    if (c->symtab) {
+        shdrs[SEC_STRTAB] = shdrs[SEC_DYNSTR];
+        shdrs[SEC_STRTAB].sh_name = shstrtab_offset(".strtab");
+        if (0 != write_at(fd, str, str_size, &offset)) {
+            goto cleanup;
+        }
+        shdrs[SEC_STRTAB].sh_offset = offset - str_size;
+
+        shdrs[SEC_SYMTAB] = shdrs[SEC_DYNSYM];
+        shdrs[SEC_SYMTAB].sh_name = shstrtab_offset(".symtab");
+        shdrs[SEC_SYMTAB].sh_type = SHT_SYMTAB;
+        shdrs[SEC_SYMTAB].sh_link = SEC_STRTAB;
+        if (0 != write_at(fd, syms, nsyms * sizeof(ElfW(Sym)), &offset)) {
+            goto cleanup;
+        }
+        shdrs[SEC_SYMTAB].sh_offset = offset - shdrs[SEC_SYMTAB].sh_size;
+    }
+
+    shdrs[SEC_SHSTRTAB].sh_name = shstrtab_offset(".shstrtab");
+    shdrs[SEC_SHSTRTAB].sh_type = SHT_STRTAB;
+    shdrs[SEC_SHSTRTAB].sh_size = sizeof(SHSTRTAB);
+    if (0 != write_at(fd, SHSTRTAB, sizeof(SHSTRTAB), &offset)) {
+        goto cleanup;
+    }
+    shdrs[SEC_SHSTRTAB].sh_offset = offset - sizeof(SHSTRTAB);
+
+    if (0 != write_at(fd, shdrs, sizeof(shdrs), &offset)) {
+        goto cleanup;
+    }
+
+    memset(&phdr, 0, sizeof(phdr));
+    phdr.p_type = PT_LOAD;
+    phdr.p_flags = PF_R | PF_X;
+    phdr.p_filesz = offset;
+    phdr.p_memsz = offset;
+    phdr.p_align = (ElfW(Xword)) sysconf(_SC_PAGESIZE);
+
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_DYN;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_phoff = sizeof(ehdr);
+    ehdr.e_shoff = offset - sizeof(shdrs);
+    ehdr.e_ehsize = sizeof(ehdr);
+    ehdr.e_phentsize = sizeof(phdr);
+    ehdr.e_phnum = 1;
+    ehdr.e_shentsize = sizeof(ElfW(Shdr));
+    ehdr.e_shnum = SEC_COUNT;
+    ehdr.e_shstrndx = SEC_SHSTRTAB;
+
+    if ((ssize_t) sizeof(ehdr) != pwrite(fd, &ehdr, sizeof(ehdr), 0) || (ssize_t) sizeof(phdr) != pwrite(fd, &phdr, sizeof(phdr), sizeof(ehdr))) {
+        goto cleanup;
+    }
+
+    *file_size = offset;
+    rc = 0;
+
+cleanup:
+    free(str);
+    free(syms);
+    free(hashes);
+    free(order);
+    free(hash);
+    close(fd);
+    return rc;
+}
+
+/**
+ * Measure the average latency of looking up <code>names</code> round-robin within the time budget
+ */
+static uint64_t measure_lookup(shared_library_t* lib, char (*names)[BENCH_NAME_SIZE], size_t count, int expected) {
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    size_t n = 0;
+
+    while (n < BENCH_MAX_LOOKUPS && elapsed < BENCH_BUDGET_NS) {
+        for (size_t i = 0; i < count; i++, n++) {
+            if ((NULL != shared_library_lookup(lib, names[i])) != expected) {
+                fprintf(stderr, "unexpected lookup result of %s\n", names[i]);
+                return 0;
+            }
+        }
+        elapsed = now_ns() - start;
+    }
+
+    return elapsed / n;
+}
+
+static int run(const char* dir, const bench_case_t* c, bench_result_t* result) {
+    static char hits[BENCH_QUERIES][BENCH_NAME_SIZE];
+    static char misses[BENCH_QUERIES][BENCH_NAME_SIZE];
+    char path[PATH_MAX];
+    shared_library_t* lib;
+    struct rusage before;
+    struct rusage after;
+    void* mapping;
+    uint64_t start;
+    long rss;
+    int fd;
+
+    memset(result, 0, sizeof(*result));
+    snprintf(path, sizeof(path), "%s/libbench-%zu-%u-%d.so", dir, c->nsyms, c->hash, c->symtab);
+
+    if (0 != generate(path, c, &result->file_size)) {
+        fprintf(stderr, "failed to generate %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    // shared_library_open locates the library from /proc/self/maps
+    if (0 > (fd = open(path, O_RDONLY | O_CLOEXEC))) {
+        unlink(path);
+        return -1;
+    }
+    mapping = mmap(NULL, result->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == mapping) {
+        unlink(path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < BENCH_QUERIES; i++) {
+        snprintf(hits[i], BENCH_NAME_SIZE, BENCH_NAME_FMT, (uint32_t) ((i * 7919) % c->nsyms));
+        snprintf(misses[i], BENCH_NAME_SIZE, BENCH_MISS_FMT, (uint32_t) i);
+    }
+
+    for (int i = 0; i < BENCH_OPENS; i++) {
+        start = now_ns();
+        lib = shared_library_open(path);
+        start = now_ns() - start;
+        if (NULL == lib) {
+            fprintf(stderr, "failed to open %s\n", path);
+            munmap(mapping, result->file_size);
+            unlink(path);
+            return -1;
+        }
+        shared_library_close(&lib);
+        result->open_ns = 0 == i ? start : (start < result->open_ns ? start : result->open_ns);
+    }
+
+    rss = get_rss_kb();
+    getrusage(RUSAGE_SELF, &before);
+
+    if (NULL != (lib = shared_library_open(path))) {
+        result->hit_ns = measure_lookup(lib, hits, BENCH_QUERIES, 1);
+        result->miss_ns = measure_lookup(lib, misses, BENCH_QUERIES, 0);
+
+        getrusage(RUSAGE_SELF, &after);
+        result->rss_kb = get_rss_kb() - rss;
+        result->minflt = after.ru_minflt - before.ru_minflt;
+        result->majflt = after.ru_majflt - before.ru_majflt;
+
+        shared_library_close(&lib);
+    }
+
+    munmap(mapping, result->file_size);
+    unlink(path);
+    return NULL == lib && 0 == result->hit_ns ? -1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    static const uint32_t hashes[] = { SHT_GNU_HASH, SHT_HASH, SHT_NULL };
+    const char* dir = argc > 1 ? argv[1] : "/tmp";
+    size_t max = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    bench_case_t c;
+    bench_result_t r;
+    int rc = 0;
+
+    for (c.nsyms = 1000; c.nsyms <= max; c.nsyms *= 10) {
+        for (size_t h = 0; h < sizeof(hashes) / sizeof(hashes[0]); h++) {
+            for (c.symtab = 0; c.symtab <= 1; c.symtab++) {
+                c.hash = hashes[h];
+
+                if (0 != run(dir, &c, &r)) {
+                    rc = 1;
+                    continue;
+                }
+
+                printf("{\"symbols\":%zu,\"hash\":\"%s\",\"symtab\":%s,\"file_size\":%zu,"
+                       "\"open_ns\":%" PRIu64 ",\"hit_ns\":%" PRIu64 ",\"miss_ns\":%" PRIu64 ","
+                       "\"rss_kb\":%ld,\"minflt\":%ld,\"majflt\":%ld}\n",
+                       c.nsyms, SHT_GNU_HASH == c.hash ? "gnu" : SHT_HASH == c.hash ? "sysv" : "none",
+                       c.symtab ? "true" : "false", r.file_size, r.open_ns, r.hit_ns, r.miss_ns,
+                       r.rss_kb, r.minflt, r.majflt);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return rc;
+}
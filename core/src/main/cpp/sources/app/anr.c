@@ -1,6 +1,9 @@
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -10,6 +13,7 @@
 #include <pthread.h>
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/param.h>
 #include <sys/syscall.h>
 
 #include <jni.h>
@@ -18,8 +22,17 @@
 #include "app.h"
 #include "defs.h"
 #include "art.h"
+#include "codec.h"
+#include "file.h"
+#include "journal.h"
 #include "log.h"
+#include "memory.h"
+#include "parser.h"
+#include "pressure.h"
 #include "procfs.h"
+#include "retention.h"
+#include "threads.h"
+#include "writer.h"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunreachable-code"
@@ -31,11 +44,36 @@ extern "C" {
 
 #define TRACE_DIVIDER_LINE "----- pid %d at %s -----\n"
 
+#define TRACE_SECTION_BEGIN "\n----- %s %d -----\n"
+
+#define TRACE_SECTION_END "----- end %d -----\n"
+
+/* the room reserved for the end of section */
+#define TRACE_SECTION_END_SIZE 32
+
 static JavaVM* jvm;
 static sigset_t old_sigset;
 static struct sigaction old_action;
 static int fd_event = -1;
 
+#define ANR_TRACE_BUFFER_SIZE (64 * 1024)
+
+#define ANR_TRACE_RESERVE_SIZE (1024 * 1024)
+
+/**
+ * The writer of trace sections, preallocated to avoid allocation while dumping
+ */
+static io_writer_t* anr_writer = NULL;
+
+#ifndef ANR_TRACE_COMPRESSION
+#define ANR_TRACE_COMPRESSION 1
+#endif
+
+/**
+ * The compressor of traces, which are written in plain text if it's <code>NULL</code>
+ */
+static io_compressor_t* anr_compressor = NULL;
+
 typedef void (*sigaction_t)(int, siginfo_t*, void*);
 
 static void handler(int sig, siginfo_t* info, void* args) {
@@ -77,22 +115,18 @@ error:
     return errno;
 }
 
-static int open_trace_file(const char* dir) {
-    char ymd[20];
-    int64_t ts;
-    struct tm* tm;
-    struct timeval tv;
-
-    gettimeofday(&tv, NULL);
-    ts = ((tv.tv_sec * 1000L) + (tv.tv_usec / 1000L));
-
-    if (NULL == (tm = localtime(&tv.tv_sec))) {
-        goto error;
-    }
-    strftime(ymd, sizeof(ymd), "%Y-%m-%d %H:%M:%S", tm);
+/**
+ * Format the name of trace file, which is suffixed by the compressor if any
+ */
+static const char* get_trace_name(char* buf, size_t size, int64_t ts) {
+    const char* suffix = NULL != anr_compressor ? io_compressor_get_suffix(anr_compressor) : "";
+    snprintf(buf, size, "trace-%"PRIi64".txt%s", ts, suffix);
+    return buf;
+}
 
+static int open_trace_file(const char* dir, const char* name, io_writer_t* writer) {
     char trace[PATH_MAX];
-    snprintf(trace, sizeof(trace), "%s/trace-%"PRIi64".txt", dir, ts);
+    snprintf(trace, sizeof(trace), "%s/%s", dir, name);
 
     int fd;
     int flags = O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC;
@@ -102,42 +136,444 @@ static int open_trace_file(const char* dir) {
         goto error;
     }
 
+    // everything is written through the compressor if any
+    if (NULL != anr_compressor) {
+        int sink = io_compressor_begin(anr_compressor, fd);
+        if (sink < 0) {
+            LOGD("failed to compress %s", trace);
+            close(fd);
+            unlink(trace);
+            goto error;
+        }
+        fd = sink;
+    }
+
     LOGD("dump trace to %s", trace);
-    dprintf(fd, TRACE_DIVIDER_LINE, getpid(), ymd);
+    io_writer_open(writer, fd, NULL != anr_compressor ? 0 : ANR_TRACE_RESERVE_SIZE);
     return fd;
 
 error:
     return -1;
 }
 
-static int check_signal_catcher_status(const char* line) {
-    return strncmp(line, "SigBlk:\t0000000000001000", 24);
+static int close_trace_file(int fd) {
+    if (NULL == anr_compressor) {
+        return close(fd);
+    }
+
+    if (0 != io_compressor_end(anr_compressor)) {
+        LOGD("failed to compress trace");
+        return -1;
+    }
+
+    return 0;
+}
+
+#define ANR_MAX_THREADS 512
+
+#define ANR_KERNEL_STATE_SIZE (256 * 1024)
+
+#define ANR_KERNEL_STATE_BUDGET_NS (100 * 1000000)
+
+#ifndef ANR_PRESSURE_INTERVAL_MS
+#define ANR_PRESSURE_INTERVAL_MS 1000
+#endif
+
+#define ANR_PRESSURE_WINDOW_S 60
+
+#define ANR_PRESSURE_SIZE (128 * 1024)
+
+/**
+ * The kernel state of threads at the moment of ANR, preallocated to avoid allocation while dumping
+ */
+static char anr_kernel_state[ANR_KERNEL_STATE_SIZE];
+
+/**
+ * The system pressure in the last minute before ANR
+ */
+static char anr_pressure[ANR_PRESSURE_SIZE];
+
+/**
+ * The buffer of streaming smaps, which must hold the longest line
+ */
+static char anr_smaps[8192];
+
+#define ANR_HEADER_SIZE 4096
+
+/**
+ * The header of trace, which is formatted ahead to be journaled
+ */
+static char anr_header[ANR_HEADER_SIZE];
+
+#define ANR_JOURNAL_NAME "graffito.journal"
+
+#define ANR_JOURNAL_SIZE (2 * 1024 * 1024)
+
+/* the bytes of runtime dump journaled at most, so that the sections journaled ahead aren't overwritten */
+#define ANR_JOURNAL_DUMP_SIZE (1024 * 1024)
+
+/**
+ * The sections written by graffito are journaled before the runtime dump, so that they could be recovered
+ * if the process is killed while dumping, which is common as it's killed by system_server soon after ANR
+ */
+static io_journal_t* anr_journal = NULL;
+
+/**
+ * The bytes of the current runtime dump journaled
+ */
+static size_t anr_journal_dump_size = 0;
+
+enum {
+    ANR_RECORD_HEADER = 1,
+    ANR_RECORD_KERNEL_THREADS,
+    ANR_RECORD_PRESSURE,
+    ANR_RECORD_RUNTIME_DUMP,
+};
+
+/**
+ * Append to <code>buf</code> of <code>len</code> bytes, the overflow is truncated
+ *
+ * @return the new length
+ */
+__attribute__((format(printf, 4, 5)))
+static size_t append_printf(char* buf, size_t size, size_t len, const char* fmt, ...) {
+    va_list ap;
+    int n;
+
+    if (len + 1 >= size) {
+        return len;
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf + len, size - len, fmt, ap);
+    va_end(ap);
+
+    return n < 0 ? len : MIN(len + (size_t) n, size - 1);
+}
+
+/**
+ * Format the memory footprint of process at the moment of ANR into the trace header
+ */
+static size_t format_footprint(char* buf, size_t size, size_t len, const procfs_footprint_t* footprint, const struct mallinfo* mi) {
+    const procfs_memory_usage_t* usage = &footprint->total;
+
+    len = append_printf(buf, size, len, "Memory (%s): rss=%" PRIu64 "kB pss=%" PRIu64 "kB pss_anon=%" PRIu64 "kB pss_file=%" PRIu64 "kB private_dirty=%" PRIu64 "kB swap_pss=%" PRIu64 "kB\n",
+            footprint->rollup ? "smaps_rollup" : "smaps", usage->rss, usage->pss, usage->pss_anon, usage->pss_file, usage->private_dirty, usage->swap_pss);
+
+    for (int i = 0; !footprint->rollup && i < PROCFS_MEMORY_CATEGORIES; i++) {
+        usage = &footprint->categories[i];
+        len = append_printf(buf, size, len, "  %-6s rss=%" PRIu64 "kB pss=%" PRIu64 "kB private_dirty=%" PRIu64 "kB swap_pss=%" PRIu64 "kB\n",
+                procfs_memory_category_name(i), usage->rss, usage->pss, usage->private_dirty, usage->swap_pss);
+    }
+
+    return append_printf(buf, size, len, "Native heap: mapped=%" PRIu64 "kB allocated=%" PRIu64 "kB free=%" PRIu64 "kB\n",
+            (uint64_t) mi->arena / 1024, (uint64_t) mi->uordblks / 1024, (uint64_t) mi->fordblks / 1024);
+}
+
+/**
+ * Format the header of trace, the footprint is skipped if it's <code>NULL</code>
+ */
+static size_t format_header(char* buf, size_t size, int64_t ts, const char* cmdline, const procfs_footprint_t* footprint, const struct mallinfo* mi) {
+    char ymd[20] = "";
+    time_t sec = (time_t) (ts / 1000);
+    struct tm tm;
+    size_t len;
+
+    if (NULL != localtime_r(&sec, &tm)) {
+        strftime(ymd, sizeof(ymd), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+
+    len = append_printf(buf, size, 0, TRACE_DIVIDER_LINE, getpid(), ymd);
+    len = append_printf(buf, size, len, "Cmd line: %s\n", cmdline);
+    return NULL != footprint ? format_footprint(buf, size, len, footprint, mi) : len;
+}
+
+/**
+ * Start a section of trace in <code>buf</code>
+ *
+ * @return the length of the beginning of section
+ */
+static size_t begin_section(char* buf, size_t size, const char* name) {
+    return append_printf(buf, size, 0, TRACE_SECTION_BEGIN, name, getpid());
+}
+
+/**
+ * End the section of <code>len</code> bytes in <code>buf</code>, which has <code>TRACE_SECTION_END_SIZE</code> bytes left
+ *
+ * @return the length of section
+ */
+static size_t end_section(char* buf, size_t size, size_t len) {
+    return append_printf(buf, size, len, TRACE_SECTION_END, getpid());
+}
+
+static void journal_section(uint32_t tag, int64_t ts, const char* section, size_t len) {
+    if (NULL != anr_journal && 0 != io_journal_append(anr_journal, tag, (uint64_t) ts, section, len)) {
+        LOGD("failed to journal section %" PRIu32, tag);
+    }
+}
+
+/**
+ * Journal the runtime dump read from the pipe of compressor in chunks, as the compressed trace can't be recovered
+ */
+static void journal_runtime_dump(const void* chunk, size_t size, void* data) {
+    int64_t ts = *(const int64_t*) data;
+
+    if (anr_journal_dump_size + size > ANR_JOURNAL_DUMP_SIZE) {
+        return;
+    }
+
+    anr_journal_dump_size += size;
+    journal_section(ANR_RECORD_RUNTIME_DUMP, ts, chunk, size);
+}
+
+#ifndef ANR_RETENTION_MAX_BYTES
+#define ANR_RETENTION_MAX_BYTES (64 * 1024 * 1024)
+#endif
+
+#ifndef ANR_RETENTION_MAX_COUNT
+#define ANR_RETENTION_MAX_COUNT 64
+#endif
+
+#ifndef ANR_RETENTION_MAX_AGE_S
+#define ANR_RETENTION_MAX_AGE_S (7 * 24 * 3600)
+#endif
+
+#define ANR_RETENTION_INDEX "graffito.index"
+
+/**
+ * The retention of traces, which is enforced after each dump
+ */
+static io_retention_t* anr_retention = NULL;
+
+static int is_trace_file(const char* name) {
+    size_t len = strlen(name);
+
+    return 0 == strncmp(name, "trace-", 6)
+            && ((len > 4 && 0 == strcmp(name + len - 4, ".txt")) || (len > 7 && 0 == strcmp(name + len - 7, ".txt.gz")));
+}
+
+/**
+ * Track the trace, then delete the oldest ones exceeding the quota
+ */
+static void retain_trace(const char* name) {
+    int deleted;
+
+    if (NULL != anr_retention && 0 < (deleted = io_retention_add(anr_retention, name))) {
+        LOGD("%d traces deleted, %zu traces of %" PRIu64 " bytes retained", deleted,
+                io_retention_get_count(anr_retention), io_retention_get_bytes(anr_retention));
+    }
+}
+
+typedef struct anr_recovery {
+    const char* dir;
+    char name[64];
+    uint64_t id;
+    int fd;
+    size_t count;
+    /* the plain trace left by the dead process, which is merged into the recovered one */
+    char merged[PATH_MAX];
+    /* the sections following the runtime dump, which are written at the end */
+    io_journal_record_t sections[2];
+    size_t nsections;
+} anr_recovery_t;
+
+static void recover_trace_done(anr_recovery_t* recovery) {
+    char name[64];
+
+    if (recovery->fd < 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < recovery->nsections; i++) {
+        io_writer_write(anr_writer, recovery->sections[i].data, recovery->sections[i].size);
+    }
+    recovery->nsections = 0;
+
+    if (0 != io_writer_close(anr_writer, NULL)) {
+        LOGD("failed to recover %s", recovery->name);
+    }
+    close(recovery->fd);
+    recovery->fd = -1;
+
+    // the partial trace if any, which isn't tracked as the process was killed
+    if ('\0' != recovery->merged[0]) {
+        unlink(recovery->merged);
+        recovery->merged[0] = '\0';
+    } else {
+        retain_trace(get_trace_name(name, sizeof(name), (int64_t) recovery->id));
+    }
+    retain_trace(recovery->name);
+}
+
+/**
+ * Copy the runtime dump from the plain trace left by the dead process, which is written by the runtime after
+ * the header directly, so that it's recovered along with the journaled sections without reading it into memory
+ */
+static void recover_runtime_dump(anr_recovery_t* recovery, const io_journal_record_t* header) {
+    char buf[ANR_HEADER_SIZE];
+    char trace[PATH_MAX];
+    int64_t n;
+    int fd;
+
+    snprintf(trace, sizeof(trace), "%s/trace-%" PRIu64 ".txt", recovery->dir, header->id);
+    if (0 > (fd = TEMP_FAILURE_RETRY(open(trace, O_RDONLY | O_CLOEXEC)))) {
+        return;
+    }
+
+    // the trace must start with the journaled header, the runtime dump follows
+    if (header->size > sizeof(buf)
+            || (ssize_t) header->size != file_read_fd_fully(fd, buf, header->size)
+            || 0 != memcmp(buf, header->data, header->size)) {
+        LOGD("%s isn't the trace of journal", trace);
+        goto done;
+    }
+
+    if (0 != io_writer_flush(anr_writer) || 0 > (n = file_copy_fd(fd, recovery->fd))) {
+        LOGD("failed to recover the runtime dump from %s: %s", trace, strerror(errno));
+        goto done;
+    }
+
+    LOGD("%" PRIi64 " bytes of runtime dump recovered from %s", n, trace);
+    snprintf(recovery->merged, sizeof(recovery->merged), "%s", trace);
+
+done:
+    close(fd);
+}
+
+/**
+ * Write the records of each dump into a trace in the order of the trace, the kernel threads and pressure,
+ * which are journaled ahead of the runtime dump, are written after it
+ */
+static int recover_trace(const io_journal_record_t* record, void* data) {
+    anr_recovery_t* recovery = data;
+    char trace[PATH_MAX];
+
+    if (0 == recovery->count++ || record->id != recovery->id) {
+        recover_trace_done(recovery);
+        recovery->id = record->id;
+
+        snprintf(recovery->name, sizeof(recovery->name), "trace-%" PRIu64 "-recovered.txt", record->id);
+        snprintf(trace, sizeof(trace), "%s/%s", recovery->dir, recovery->name);
+        if (0 > (recovery->fd = TEMP_FAILURE_RETRY(open(trace, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRWXU | S_IRGRP | S_IROTH)))) {
+            LOGD("failed to open %s: %s", trace, strerror(errno));
+            return 0;
+        }
+
+        LOGD("recover trace to %s", trace);
+        io_writer_open(anr_writer, recovery->fd, 0);
+    }
+
+    if (recovery->fd < 0) {
+        return 0;
+    }
+
+    // the records are valid until the journal is changed
+    if ((ANR_RECORD_KERNEL_THREADS == record->tag || ANR_RECORD_PRESSURE == record->tag)
+            && recovery->nsections < ARRAY_SIZE(recovery->sections)) {
+        recovery->sections[recovery->nsections++] = *record;
+        return 0;
+    }
+
+    io_writer_write(anr_writer, record->data, record->size);
+    if (ANR_RECORD_HEADER == record->tag) {
+        recover_runtime_dump(recovery, record);
+    }
+
+    return 0;
+}
+
+static void retain_traces(const char* dir) {
+    io_retention_policy_t policy = {
+        .max_bytes = ANR_RETENTION_MAX_BYTES,
+        .max_count = ANR_RETENTION_MAX_COUNT,
+        .max_age_s = ANR_RETENTION_MAX_AGE_S,
+    };
+
+    // the directory is scanned only if the index is missing
+    if (NULL == anr_retention && NULL == (anr_retention = io_retention_open(dir, ANR_RETENTION_INDEX, &policy, is_trace_file))) {
+        return;
+    }
+
+    io_retention_enforce(anr_retention);
+}
+
+/**
+ * Open the journal, and recover the sections left by the previous process which was killed while dumping
+ */
+static void recover_traces(const char* dir) {
+    anr_recovery_t recovery = { .dir = dir, .fd = -1 };
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/" ANR_JOURNAL_NAME, dir);
+    if (NULL == anr_journal && NULL == (anr_journal = io_journal_open(path, ANR_JOURNAL_SIZE))) {
+        return;
+    }
+
+    io_journal_foreach(anr_journal, recover_trace, &recovery);
+    recover_trace_done(&recovery);
+    io_journal_clear(anr_journal);
+}
+
+#define SIGNAL_CATCHER_SIG_BLK (UINT64_C(1) << (SIGQUIT - 1))
+
+/**
+ * The Signal Catcher blocks SIGQUIT and waits for it by <code>sigwait</code>, which unblocks the signals
+ * waited for until it returns, so that SIGQUIT is absent from the <code>SigBlk</code> of a waiting catcher,
+ * e.g. <code>0000000000001000</code> with SIGPIPE blocked only, while it's blocked by the other threads
+ */
+static int is_signal_catcher(const char* name, uint64_t sig_blk) {
+    return 0 == strcmp("Signal Catcher", name) && 0 == (SIGNAL_CATCHER_SIG_BLK & sig_blk);
 }
 
 static int select_signal_catcher(pid_t tid) {
-    char name[16];
-    procfs_get_task_comm(tid, name, sizeof(name));
-    if (0 != strcmp("Signal Catcher", name)) {
+    char buf[2048];
+    procfs_status_t status;
+
+    if (0 != procfs_read_status(tid, buf, sizeof(buf), &status)) {
         return -1;
     }
 
-    char line[256];
-    return NULL == procfs_get_thread_status(tid, line, sizeof(line), check_signal_catcher_status);
+    return is_signal_catcher(status.name, status.sig_blk) ? 0 : -1;
 }
 
-static void anr_rethrow(void) {
+/**
+ * Find the Signal Catcher, the cached tid is revalidated by a single read of its status,
+ * and the threads are scanned only if it's gone
+ */
+static pid_t find_signal_catcher(void) {
+    static procfs_thread_t threads[ANR_MAX_THREADS];
     static pid_t tid = -1;
-    if (tid < 0) {
-        if (0 > (tid = procfs_get_tid(select_signal_catcher))) {
-            LOGD("Signal Catcher not found");
+    ssize_t n;
+
+    if (tid > 0 && 0 == select_signal_catcher(tid)) {
+        return tid;
+    }
+
+    tid = -1;
+    if (0 > (n = procfs_snapshot_threads(threads, ARRAY_SIZE(threads)))) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < MIN((size_t) n, ARRAY_SIZE(threads)); i++) {
+        if (is_signal_catcher(threads[i].comm, threads[i].sig_blk)) {
+            tid = threads[i].tid;
+            break;
         }
     }
 
-    LOGD("[Signal Catcher] tid=%d", tid);
+    return tid;
+}
 
-    if (tid >= 0) {
-        syscall(SYS_tgkill, getpid(), tid, SIGQUIT);
+static void anr_rethrow(void) {
+    pid_t tid = find_signal_catcher();
+
+    if (0 > tid) {
+        LOGD("Signal Catcher not found");
+        return;
     }
+
+    LOGD("[Signal Catcher] tid=%d", tid);
+    syscall(SYS_tgkill, getpid(), tid, SIGQUIT);
 }
 
 /**
@@ -158,17 +594,33 @@ static void* anr_dumper(void* args) {
         goto exit;
     }
 
-    // app files dir
+    // app files dir, which is resolved on ANR if the application isn't ready yet
     char files[PATH_MAX];
-    get_files_path(env, files, sizeof(files));
-    LOGD("files: %s", files);
+    const char* dir = get_files_path(env, files, sizeof(files));
+    LOGD("files: %s", NULL != dir ? dir : "?");
 
     // app process name
     char cmdline[1024];
     get_cmdline(cmdline, sizeof(cmdline));
     LOGD("cmdline: %s", cmdline);
 
+    if (NULL != dir) {
+        retain_traces(dir);
+        recover_traces(dir);
+    }
+
     int fd;
+    int rc;
+    int64_t ts;
+    struct timeval tv;
+    char name[64];
+    size_t header_len;
+    size_t len;
+    size_t pressure_len;
+    procfs_footprint_t footprint;
+    struct mallinfo mi;
+    int footprint_rc;
+    io_writer_stats_t stats;
     uint64_t flag = 0;
 
     for (;;) {
@@ -176,11 +628,49 @@ static void* anr_dumper(void* args) {
             break;
         }
 
-        if ((fd = open_trace_file(files)) < 0) {
+        if (NULL == dir && NULL != (dir = get_files_path(env, files, sizeof(files)))) {
+            retain_traces(dir);
+            recover_traces(dir);
+        }
+        if (NULL == dir) {
+            LOGD("files dir unavailable");
+            anr_rethrow();
+            continue;
+        }
+
+        gettimeofday(&tv, NULL);
+        ts = ((tv.tv_sec * 1000L) + (tv.tv_usec / 1000L));
+
+        // before the runtime dump which takes a while
+        footprint_rc = procfs_read_footprint(anr_smaps, sizeof(anr_smaps), &footprint);
+        mi = mallinfo();
+        header_len = format_header(anr_header, sizeof(anr_header), ts, cmdline, 0 == footprint_rc ? &footprint : NULL, &mi);
+
+        len = begin_section(anr_kernel_state, sizeof(anr_kernel_state), "kernel threads");
+        len += procfs_dump_threads(anr_kernel_state + len, sizeof(anr_kernel_state) - len - TRACE_SECTION_END_SIZE, ANR_KERNEL_STATE_BUDGET_NS);
+        len = end_section(anr_kernel_state, sizeof(anr_kernel_state), len);
+
+        pressure_len = begin_section(anr_pressure, sizeof(anr_pressure), "pressure");
+        pressure_len += pressure_dump(anr_pressure + pressure_len, sizeof(anr_pressure) - pressure_len - TRACE_SECTION_END_SIZE, ANR_PRESSURE_WINDOW_S);
+        pressure_len = end_section(anr_pressure, sizeof(anr_pressure), pressure_len);
+
+        journal_section(ANR_RECORD_HEADER, ts, anr_header, header_len);
+        journal_section(ANR_RECORD_KERNEL_THREADS, ts, anr_kernel_state, len);
+        journal_section(ANR_RECORD_PRESSURE, ts, anr_pressure, pressure_len);
+
+        if ((fd = open_trace_file(dir, get_trace_name(name, sizeof(name), ts), anr_writer)) < 0) {
             continue;
         }
 
-        dprintf(fd, "Cmd line: %s\n", cmdline);
+        io_writer_write(anr_writer, anr_header, header_len);
+
+        // the runtime writes to stderr directly
+        io_writer_flush(anr_writer);
+
+        if (NULL != anr_compressor && NULL != anr_journal) {
+            anr_journal_dump_size = 0;
+            io_compressor_tee(anr_compressor, journal_runtime_dump, &ts);
+        }
 
         if (dup2(fd, STDERR_FILENO) < 0) {
             LOGD("failed to redirect stderr to fd (%d)", fd);
@@ -197,8 +687,25 @@ static void* anr_dumper(void* args) {
     done:
         fflush(NULL);
         dup2(fd_dev_null, STDERR_FILENO);
-        close(fd);
+        if (NULL != anr_compressor && NULL != anr_journal) {
+            io_compressor_tee(anr_compressor, NULL, NULL);
+            LOGD("%zu bytes of runtime dump journaled", anr_journal_dump_size);
+        }
+        io_writer_write(anr_writer, anr_kernel_state, len);
+        io_writer_write(anr_writer, anr_pressure, pressure_len);
+        if (0 != (rc = io_writer_close(anr_writer, &stats))) {
+            LOGD("failed to write trace");
+        }
+        LOGD("%" PRIu64 " bytes written with %" PRIu32 " syscalls", stats.bytes, stats.syscalls);
+
+        // the journal is kept for recovery unless the trace is complete
+        if (0 == close_trace_file(fd) && 0 == rc && NULL != anr_journal) {
+            io_journal_clear(anr_journal);
+        }
         anr_rethrow();
+
+        // off the critical path since the system is notified
+        retain_trace(name);
     }
 
     LOGD("trace dumper quit");
@@ -228,6 +735,24 @@ int anr_watch(JavaVM* vm) {
         goto cleanup;
     }
 
+    if (NULL == anr_writer && NULL == (anr_writer = io_writer_create(ANR_TRACE_BUFFER_SIZE))) {
+        rc = ENOMEM;
+        goto cleanup;
+    }
+
+    if (ANR_TRACE_COMPRESSION && NULL == anr_compressor && NULL == (anr_compressor = io_compressor_create(&io_codec_gzip))) {
+        LOGD("traces are not compressed");
+    }
+
+    // io_uring and the arena are set up ahead of ANR
+    if (0 != procfs_dump_threads_init()) {
+        LOGD("failed to prepare thread dump");
+    }
+
+    if (0 != pressure_start(ANR_PRESSURE_INTERVAL_MS)) {
+        LOGD("failed to sample pressure");
+    }
+
     pthread_t thread;
     if (0 != (rc = pthread_create(&thread, NULL, anr_dumper, NULL))) {
         goto cleanup;
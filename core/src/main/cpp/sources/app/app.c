@@ -9,6 +9,7 @@
 #include <jni.h>
 
 #include "app.h"
+#include "parser.h"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wgnu-statement-expression"
@@ -23,25 +24,75 @@ extern "C" {
 #define CLASS_ACTIVITY_THREAD "android/app/ActivityThread"
 #define CLASS_CONTEXT         "android/content/Context"
 
+/**
+ * Clear the pending exception if any
+ *
+ * @return non-zero if there was an exception
+ */
+static int clear_exception(JNIEnv* env) {
+    if (!(*env)->ExceptionCheck(env)) {
+        return 0;
+    }
+
+    (*env)->ExceptionClear(env);
+    return 1;
+}
+
 static jobject get_application(JNIEnv* env) {
     jclass class_activity_thread = (*env)->FindClass(env, CLASS_ACTIVITY_THREAD);
+    if (clear_exception(env) || NULL == class_activity_thread) {
+        return NULL;
+    }
+
     jmethodID method_current_application = (*env)->GetStaticMethodID(env, class_activity_thread, "currentApplication", "()L"CLASS_APPLICATION";");
-    return (*env)->CallStaticObjectMethod(env, class_activity_thread, method_current_application);
+    if (clear_exception(env) || NULL == method_current_application) {
+        return NULL;
+    }
+
+    jobject app = (*env)->CallStaticObjectMethod(env, class_activity_thread, method_current_application);
+    return clear_exception(env) ? NULL : app;
 }
 
 static jobject get_files_dir(JNIEnv* env) {
+    // the application isn't created yet if it's loaded early, e.g. by a content provider
     jobject app = get_application(env);
+    if (NULL == app) {
+        return NULL;
+    }
+
     jclass class_context = (*env)->FindClass(env, CLASS_CONTEXT);
     jmethodID method_get_files_dir = (*env)->GetMethodID(env, class_context, "getFilesDir", "()L"CLASS_FILE";");
-    return (*env)->CallObjectMethod(env, app, method_get_files_dir);
+    if (clear_exception(env) || NULL == method_get_files_dir) {
+        return NULL;
+    }
+
+    jobject files = (*env)->CallObjectMethod(env, app, method_get_files_dir);
+    return clear_exception(env) ? NULL : files;
 }
 
 const char* get_files_path(JNIEnv* env, char* buf, size_t n) {
     jobject files = get_files_dir(env);
+    if (NULL == files) {
+        return NULL;
+    }
+
     jclass class_file = (*env)->FindClass(env, CLASS_FILE);
     jmethodID method_get_canonical_path = (*env)->GetMethodID(env, class_file, "getCanonicalPath", "()L"CLASS_STRING";");
+    if (clear_exception(env) || NULL == method_get_canonical_path) {
+        return NULL;
+    }
+
     jstring canonical_path = (*env)->CallObjectMethod(env, files, method_get_canonical_path);
+    if (clear_exception(env) || NULL == canonical_path) {
+        return NULL;
+    }
+
     const char* path = (*env)->GetStringUTFChars(env, canonical_path, NULL);
+    if (NULL == path) {
+        clear_exception(env);
+        return NULL;
+    }
+
     snprintf(buf, n, "%s", path);
     (*env)->ReleaseStringUTFChars(env, canonical_path, path);
     return buf;
@@ -49,17 +100,12 @@ const char* get_files_path(JNIEnv* env, char* buf, size_t n) {
 
 
 const char* get_cmdline(char* buf, size_t n) {
-    char cmdline[1024];
-    snprintf(cmdline, sizeof(cmdline), "/proc/%d/cmdline", getpid());
+    ssize_t len;
 
-    int fd = TEMP_FAILURE_RETRY(open(cmdline, O_RDONLY));
-    if (fd < 0) {
+    if (0 >= (len = procfs_read_task(0, "cmdline", buf, n))) {
         return NULL;
     }
 
-    TEMP_FAILURE_RETRY(read(fd, buf, n));
-    TEMP_FAILURE_RETRY(close(fd));
-
     // trim tailing whitespace
     char* end = buf + strlen(buf) - 1;
     while (end > buf && isspace((unsigned char) *end)) end--;
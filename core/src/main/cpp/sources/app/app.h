@@ -10,6 +10,11 @@ extern "C" {
 
 const char* get_cmdline(char* buf, size_t n);
 
+/**
+ * Get the files dir of application
+ *
+ * @return <code>buf</code>, or <code>NULL</code> if the application isn't created yet
+ */
 const char* get_files_path(JNIEnv* env, char* buf, size_t n);
 
 #ifdef __cplusplus
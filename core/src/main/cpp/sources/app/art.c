@@ -8,10 +8,14 @@
 #include <jni.h>
 
 #include "anr.h"
+#include "app.h"
 #include "defs.h"
 #include "art.h"
 #include "log.h"
 #include "linker.h"
+#include "procfs.h"
+#include "symcache.h"
+#include "symindex.h"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wpadded"
@@ -85,74 +89,116 @@ typedef struct runtime {
 
 static runtime_t runtime;
 
-int art_init(void) {
+int art_init(const char* cache) {
     static int initialized = 0;
     if (0 != initialized) {
         return 0;
     }
 
-    char pathname[128];
-    shared_library_t* libcpp = NULL;
-    shared_library_t* libart = NULL;
-    int rc = -1;
+    const char* pathname = NULL;
+    shared_library_t* libart;
+    int rc;
 
     memset(&runtime, 0, sizeof(runtime));
     runtime.api_level = android_get_device_api_level();
 
+    const char* libcpp_symbols[] = {
+        LIBCPP_CERR,
+    };
+    void* libcpp_addresses[ARRAY_SIZE(libcpp_symbols)];
+
+    // Android Lollipop needs art::Dbg::SuspendVM() and art::Dbg::ResumeVM() additionally
+    const char* libart_symbols[] = {
+        LIBART_RUNTIME_INSTANCE,
+        LIBART_RUNTIME_DUMP_FOR_SIGQUIT,
+        LIBART_DBG_SUSPEND_VM,
+        LIBART_DBG_RESUME_VM,
+    };
+    // mangled names vary across releases, signatures are the fallback
+    const char* libart_signatures[ARRAY_SIZE(libart_symbols)] = {
+        "art::Runtime::instance_",
+        "art::Runtime::DumpForSigQuit(*)",
+        "art::Dbg::SuspendVM()",
+        "art::Dbg::ResumeVM()",
+    };
+    void* libart_addresses[ARRAY_SIZE(libart_symbols)];
+    size_t count = LOLLIPOP ? ARRAY_SIZE(libart_symbols) : 2;
+
+    // the loaded ones of the candidates are told by one pass over the mappings, the others aren't tried
+    const char* candidates[] = {
+        APEX_LIBCPP,
+        APEX_LIBART_30,
+        APEX_LIBART_29,
+    };
+    uintptr_t bases[ARRAY_SIZE(candidates)];
+
+    // all of them are tried if none is found, e.g. the mappings are unreadable
+    if (ARRAY_SIZE(candidates) == procfs_get_map_addresses(candidates, bases, ARRAY_SIZE(candidates))) {
+        memset(bases, 0xff, sizeof(bases));
+    }
+
     // load c++.so
-    if (runtime.api_level >= 29) {
-        if (NULL == (libcpp = shared_library_open(APEX_LIBCPP))) {
+    rc = -1;
+    if (runtime.api_level >= 29 && 0 != bases[0]) {
+        if (0 > (rc = symcache_resolve(cache, pathname = APEX_LIBCPP, libcpp_symbols, libcpp_addresses, ARRAY_SIZE(libcpp_symbols)))) {
             LOGD("cannot load "APEX_LIBCPP);
         }
     }
-    if (NULL == libcpp && NULL == (libcpp = shared_library_open(LIBCPP))) {
+    if (0 > rc && 0 > (rc = symcache_resolve(cache, pathname = LIBCPP, libcpp_symbols, libcpp_addresses, ARRAY_SIZE(libcpp_symbols)))) {
         LOGD("cannot load "LIBCPP);
         goto art;
     }
 
-    shared_library_get_pathname(libcpp, pathname, sizeof(pathname));
-
     // load cerr
-    if (NULL == (runtime.cerr = shared_library_lookup(libcpp, LIBCPP_CERR))) {
+    if (NULL == (runtime.cerr = libcpp_addresses[0])) {
         LOGD("cannot load symbol "LIBCPP_CERR" from %s", pathname);
         goto art;
     }
 
 art: // load art.so
-    if (runtime.api_level >= 30) {
-        if (NULL == (libart = shared_library_open(APEX_LIBART_30))) {
+    rc = -1;
+    if (runtime.api_level >= 30 && 0 != bases[1]) {
+        if (0 > (rc = symcache_resolve(cache, pathname = APEX_LIBART_30, libart_symbols, libart_addresses, count))) {
             LOGD("cannot load "APEX_LIBART_30);
         }
-    } else if (runtime.api_level >= 29) {
-        if (NULL == (libart = shared_library_open(APEX_LIBART_29))) {
+    } else if (runtime.api_level >= 29 && 0 != bases[2]) {
+        if (0 > (rc = symcache_resolve(cache, pathname = APEX_LIBART_29, libart_symbols, libart_addresses, count))) {
             LOGD("cannot load "APEX_LIBART_29);
         }
     }
-    if (NULL == libart && NULL == (libart = shared_library_open(LIBART))) {
+    if (0 > rc && 0 > (rc = symcache_resolve(cache, pathname = LIBART, libart_symbols, libart_addresses, count))) {
         LOGD("cannot load "LIBART);
-        goto cleanup;
+        return -1;
     }
 
-    shared_library_get_pathname(libart, pathname, sizeof(pathname));
+    if (0 < rc && NULL != (libart = shared_library_open_with_cache(pathname, cache))) {
+        for (size_t i = 0; i < count; i++) {
+            if (NULL == libart_addresses[i] && NULL != (libart_addresses[i] = shared_library_lookup_signature(libart, libart_signatures[i]))) {
+                rc--;
+            }
+        }
 
-    if (NULL == (runtime.instance = (void**) shared_library_lookup(libart, LIBART_RUNTIME_INSTANCE))) {
-        LOGD("cannot load symbol "LIBART_RUNTIME_INSTANCE" from %s", pathname);
-        goto cleanup;
+        // otherwise, libart is parsed again on every launch
+        if (0 == rc && 0 == symcache_save(cache, pathname, libart_symbols, libart_addresses, count, shared_library_get_address(libart))) {
+            LOGD("cached the symbols of %s resolved by signatures", pathname);
+        }
+        shared_library_close(&libart);
     }
-    if (NULL == (runtime.dumpForSigQuit = (DumpForSigQuit) shared_library_lookup(libart, LIBART_RUNTIME_DUMP_FOR_SIGQUIT))) {
-        LOGD("cannot load symbol "LIBART_RUNTIME_DUMP_FOR_SIGQUIT" from %s", pathname);
-        goto cleanup;
+
+    if (0 != rc) {
+        for (size_t i = 0; i < count; i++) {
+            if (NULL == libart_addresses[i]) {
+                LOGD("cannot load symbol %s from %s", libart_symbols[i], pathname);
+            }
+        }
+        return -1;
     }
-    // Android Lollipop
+
+    runtime.instance = (void**) libart_addresses[0];
+    runtime.dumpForSigQuit = (DumpForSigQuit) libart_addresses[1];
     if (LOLLIPOP) {
-        if (NULL == (runtime.resumeVM = (ResumeVM) shared_library_lookup(libart, LIBART_DBG_SUSPEND_VM))) {
-            LOGD("cannot load symbol "LIBART_DBG_SUSPEND_VM" from %s", pathname);
-            goto cleanup;
-        }
-        if (NULL == (runtime.suspendVM = (SuspendVM) shared_library_lookup(libart, LIBART_DBG_RESUME_VM))) {
-            LOGD("cannot load symbol "LIBART_DBG_RESUME_VM" from %s", pathname);
-            goto cleanup;
-        }
+        runtime.suspendVM = (SuspendVM) libart_addresses[2];
+        runtime.resumeVM = (ResumeVM) libart_addresses[3];
     }
 
     LOGD(" std::cerr                       %"PRIxPTR, (uintptr_t) runtime.cerr);
@@ -162,17 +208,8 @@ art: // load art.so
     LOGD(" art::Dbg::SuspendVM             %"PRIxPTR, (uintptr_t) runtime.suspendVM);
     LOGD(" art::Dbg::ResumeVM              %"PRIxPTR, (uintptr_t) runtime.resumeVM);
 
-    rc = 0;
     initialized = 1;
-
-cleanup:
-    if (NULL != libcpp) {
-        shared_library_close(&libcpp);
-    }
-    if (NULL != libart) {
-        shared_library_close(&libart);
-    }
-    return rc;
+    return 0;
 }
 
 int art_dump(void) {
@@ -202,10 +239,17 @@ JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
         return JNI_ERR;
     }
 
-    if (0 != art_init() || 0 != anr_watch(vm)) {
+    // the symbols are resolved without cache if the application isn't ready
+    char files[PATH_MAX];
+    const char* cache = get_files_path(env, files, sizeof(files));
+
+    if (0 != art_init(cache) || 0 != anr_watch(vm)) {
         return JNI_ERR;
     }
 
+    // not required by ANR dumping, so it's built lazily off the main thread
+    symindex_build_async();
+
     return JNI_VERSION_1_6;
 }
 
@@ -5,7 +5,13 @@
 extern "C" {
 #endif
 
-int art_init(void);
+/**
+ * Resolve the ART runtime symbols
+ *
+ * @param cache the directory of symbol cache, or <code>NULL</code> to bypass the cache
+ * @return 0 if succeeded
+ */
+int art_init(const char* cache);
 
 int art_dump(void);
 
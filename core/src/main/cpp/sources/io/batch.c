@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "batch.h"
+#include "log.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+#define IO_BATCH_MAX_ENTRIES 256
+
+/*
+ * io_uring is opted out on Android, the seccomp filter of apps kills the process by SIGSYS on io_uring_setup
+ * rather than failing it, so that it can't be probed in process
+ */
+#ifndef IO_BATCH_URING
+#if defined(__ANDROID__)
+#define IO_BATCH_URING 0
+#else
+#define IO_BATCH_URING 1
+#endif
+#endif
+
+typedef struct io_uring_ring {
+    int fd;
+    unsigned entries;
+
+    void* sq;
+    size_t sq_size;
+    void* cq;
+    size_t cq_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    _Atomic unsigned* sq_head;
+    _Atomic unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+
+    _Atomic unsigned* cq_head;
+    _Atomic unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+} io_uring_ring_t;
+
+struct io_batch {
+    char* arena;
+    size_t arena_size;
+    size_t used;
+
+    size_t capacity;
+    size_t count;
+    int* fds;
+    struct iovec* iovs;
+    ssize_t* results;
+
+    /* fd is -1 if io_uring is unavailable */
+    io_uring_ring_t ring;
+};
+
+/**
+ * Whether io_uring is opted out or blocked, which won't change in the process
+ */
+static atomic_int io_uring_disabled = !IO_BATCH_URING;
+
+static void io_uring_close(io_uring_ring_t* ring) {
+    if (NULL != ring->sqes && MAP_FAILED != ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (NULL != ring->cq && MAP_FAILED != ring->cq && ring->cq != ring->sq) {
+        munmap(ring->cq, ring->cq_size);
+    }
+    if (NULL != ring->sq && MAP_FAILED != ring->sq) {
+        munmap(ring->sq, ring->sq_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static int io_uring_open(io_uring_ring_t* ring, unsigned entries) {
+    struct io_uring_params params;
+    uint8_t* sq;
+    uint8_t* cq;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    if (atomic_load(&io_uring_disabled)) {
+        ring->fd = -1;
+        return -1;
+    }
+
+    if (0 > (ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params))) {
+        LOGD("io_uring unavailable : %s", strerror(errno));
+        atomic_store(&io_uring_disabled, 1);
+        ring->fd = -1;
+        return -1;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_size = ring->cq_size = ring->sq_size > ring->cq_size ? ring->sq_size : ring->cq_size;
+    }
+
+    ring->sq = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ring->sq) {
+        goto error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq = ring->sq;
+    } else if (MAP_FAILED == (ring->cq = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING))) {
+        goto error;
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == ring->sqes) {
+        goto error;
+    }
+
+    sq = ring->sq;
+    cq = ring->cq;
+    // the offsets are aligned by the kernel
+    ring->sq_head = (void*) (sq + params.sq_off.head);
+    ring->sq_tail = (void*) (sq + params.sq_off.tail);
+    ring->sq_mask = *(const unsigned*) (const void*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (void*) (sq + params.sq_off.array);
+    ring->cq_head = (void*) (cq + params.cq_off.head);
+    ring->cq_tail = (void*) (cq + params.cq_off.tail);
+    ring->cq_mask = *(const unsigned*) (const void*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (void*) (cq + params.cq_off.cqes);
+    return 0;
+
+error:
+    LOGD("io_uring mmap failed : %s", strerror(errno));
+    io_uring_close(ring);
+    return -1;
+}
+
+/**
+ * Submit the reads in [from, to) which must fit in the ring, and wait for all of them
+ *
+ * @return 0 if all completed
+ */
+static int io_uring_read(io_batch_t* thiz, size_t from, size_t to) {
+    io_uring_ring_t* ring = &thiz->ring;
+    unsigned tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    unsigned n = (unsigned) (to - from);
+    unsigned submit = n;
+    unsigned completed = 0;
+    unsigned head;
+    long rc;
+
+    for (size_t i = from; i < to; i++, tail++) {
+        unsigned index = tail & ring->sq_mask;
+        struct io_uring_sqe* sqe = &ring->sqes[index];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = thiz->fds[i];
+        sqe->addr = (uint64_t) (uintptr_t) &thiz->iovs[i];
+        sqe->len = 1;
+        sqe->off = 0;
+        sqe->user_data = i;
+        ring->sq_array[index] = index;
+    }
+    atomic_store_explicit(ring->sq_tail, tail, memory_order_release);
+
+    while (completed < n) {
+        // submit everything at once, then wait for the rest
+        rc = syscall(__NR_io_uring_enter, ring->fd, submit, n - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && EINTR != errno) {
+            return -1;
+        }
+        if (rc > 0) {
+            submit -= (unsigned) rc < submit ? (unsigned) rc : submit;
+        }
+
+        head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+        for (; head != atomic_load_explicit(ring->cq_tail, memory_order_acquire); head++, completed++) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+            thiz->results[cqe->user_data] = cqe->res < 0 ? -1 : cqe->res;
+        }
+        atomic_store_explicit(ring->cq_head, head, memory_order_release);
+    }
+
+    return 0;
+}
+
+static void io_preadv(io_batch_t* thiz, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++) {
+        thiz->results[i] = TEMP_FAILURE_RETRY(preadv(thiz->fds[i], &thiz->iovs[i], 1, 0));
+    }
+}
+
+io_batch_t* io_batch_create(size_t capacity, size_t arena_size) {
+    io_batch_t* thiz;
+
+    if (NULL == (thiz = calloc(1, sizeof(io_batch_t)))) {
+        return NULL;
+    }
+
+    thiz->capacity = capacity;
+    thiz->arena_size = arena_size;
+    thiz->ring.fd = -1;
+
+    if (NULL == (thiz->arena = malloc(arena_size))
+            || NULL == (thiz->fds = calloc(capacity, sizeof(int)))
+            || NULL == (thiz->iovs = calloc(capacity, sizeof(struct iovec)))
+            || NULL == (thiz->results = calloc(capacity, sizeof(ssize_t)))) {
+        io_batch_destroy(&thiz);
+        return NULL;
+    }
+
+    // touch the arena now rather than while reading
+    memset(thiz->arena, 0, arena_size);
+
+    io_uring_open(&thiz->ring, (unsigned) (capacity < IO_BATCH_MAX_ENTRIES ? capacity : IO_BATCH_MAX_ENTRIES));
+    return thiz;
+}
+
+ssize_t io_batch_add(io_batch_t* thiz, int fd, size_t size) {
+    size_t index = thiz->count;
+
+    if (index >= thiz->capacity || 0 == size || size > thiz->arena_size - thiz->used) {
+        return -1;
+    }
+
+    thiz->fds[index] = fd;
+    thiz->iovs[index].iov_base = thiz->arena + thiz->used;
+    thiz->iovs[index].iov_len = size - 1;
+    thiz->results[index] = -1;
+    thiz->used += size;
+    thiz->count++;
+    return (ssize_t) index;
+}
+
+ssize_t io_batch_submit(io_batch_t* thiz) {
+    ssize_t succeeded = 0;
+    size_t to;
+
+    for (size_t from = 0; from < thiz->count; from = to) {
+        to = thiz->ring.fd >= 0 && thiz->count - from > thiz->ring.entries ? from + thiz->ring.entries : thiz->count;
+
+        if (thiz->ring.fd < 0) {
+            io_preadv(thiz, from, to);
+        } else if (0 != io_uring_read(thiz, from, to)) {
+            // the reads in flight are cancelled with the ring
+            LOGD("io_uring_enter failed : %s", strerror(errno));
+            atomic_store(&io_uring_disabled, 1);
+            io_uring_close(&thiz->ring);
+            io_preadv(thiz, from, thiz->count);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < thiz->count; i++) {
+        char* slot = thiz->iovs[i].iov_base;
+        slot[thiz->results[i] < 0 ? 0 : thiz->results[i]] = '\0';
+        succeeded += thiz->results[i] >= 0;
+    }
+
+    return succeeded;
+}
+
+ssize_t io_batch_get(io_batch_t* thiz, size_t index, char** content) {
+    if (index >= thiz->count) {
+        return -1;
+    }
+
+    *content = thiz->iovs[index].iov_base;
+    return thiz->results[index];
+}
+
+size_t io_batch_get_count(io_batch_t* thiz) {
+    return thiz->count;
+}
+
+void io_batch_reset(io_batch_t* thiz) {
+    for (size_t i = 0; i < thiz->count; i++) {
+        close(thiz->fds[i]);
+    }
+
+    thiz->count = 0;
+    thiz->used = 0;
+}
+
+int io_batch_is_uring(io_batch_t* thiz) {
+    return thiz->ring.fd >= 0;
+}
+
+void io_batch_destroy(io_batch_t** thiz) {
+    if (NULL == thiz || NULL == *thiz) {
+        return;
+    }
+
+    if (NULL != (*thiz)->fds) {
+        io_batch_reset(*thiz);
+    }
+    io_uring_close(&(*thiz)->ring);
+    free((*thiz)->arena);
+    free((*thiz)->fds);
+    free((*thiz)->iovs);
+    free((*thiz)->results);
+    free(*thiz);
+    *thiz = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
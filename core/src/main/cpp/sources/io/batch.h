@@ -0,0 +1,71 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A batch of small reads from offset 0 landing in the slots of one preallocated arena, all of them are
+ * submitted at once through <code>io_uring</code>, or a tight <code>preadv</code> loop if it's unavailable.
+ * <code>io_uring</code> is used only if <code>IO_BATCH_URING</code> is non-zero, which is off on Android.
+ *
+ * A batch isn't thread safe.
+ */
+typedef struct io_batch io_batch_t;
+
+/**
+ * Create a batch
+ *
+ * @param capacity the max number of reads
+ * @param arena_size the size of arena shared by the slots of reads
+ */
+io_batch_t* io_batch_create(size_t capacity, size_t arena_size);
+
+/**
+ * Add a read of <code>fd</code>, which is owned by the batch until it's reset
+ *
+ * @param size the size of slot including the trailing <code>'\0'</code>
+ * @return the index of read, or <code>-1</code> if the batch is full
+ */
+ssize_t io_batch_add(io_batch_t* thiz, int fd, size_t size);
+
+/**
+ * Submit the reads added
+ *
+ * @return the number of reads succeeded, or <code>-1</code> if failed
+ */
+ssize_t io_batch_submit(io_batch_t* thiz);
+
+/**
+ * Get the result of read at <code>index</code>, the content is terminated with <code>'\0'</code>
+ *
+ * @return the length of content, or <code>-1</code> if failed
+ */
+ssize_t io_batch_get(io_batch_t* thiz, size_t index, char** content);
+
+/**
+ * @return the number of reads added
+ */
+size_t io_batch_get_count(io_batch_t* thiz);
+
+/**
+ * Close the descriptors and release the slots for the next batch
+ */
+void io_batch_reset(io_batch_t* thiz);
+
+/**
+ * @return 1 if the reads are submitted through <code>io_uring</code>
+ */
+int io_batch_is_uring(io_batch_t* thiz);
+
+void io_batch_destroy(io_batch_t** thiz);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* BATCH_H */
@@ -0,0 +1,231 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "codec.h"
+#include "log.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COMPRESSOR_BUFFER_SIZE (64 * 1024)
+
+struct io_compressor {
+    const io_codec_t* codec;
+    void* state;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    /* the read end of pipe being compressed, or -1 if idle */
+    int in;
+    int out;
+    int writer;
+    int done;
+    int rc;
+
+    /* 1 if the stream is about to read the pipe, which means the data read so far are processed */
+    int waiting;
+    io_compressor_tee_t tee;
+    void* tee_data;
+
+    char buf[COMPRESSOR_BUFFER_SIZE];
+};
+
+/**
+ * Compress the pipe until all of its write ends are closed
+ */
+static int io_compressor_run_stream(io_compressor_t* thiz) {
+    io_compressor_tee_t tee;
+    void* tee_data;
+    ssize_t n;
+    int rc = thiz->codec->begin(thiz->state, thiz->out);
+
+    for (;;) {
+        pthread_mutex_lock(&thiz->mutex);
+        thiz->waiting = 1;
+        pthread_cond_broadcast(&thiz->cond);
+        pthread_mutex_unlock(&thiz->mutex);
+
+        n = TEMP_FAILURE_RETRY(read(thiz->in, thiz->buf, sizeof(thiz->buf)));
+
+        pthread_mutex_lock(&thiz->mutex);
+        thiz->waiting = 0;
+        tee = thiz->tee;
+        tee_data = thiz->tee_data;
+        pthread_mutex_unlock(&thiz->mutex);
+
+        if (0 > n) {
+            rc = -1;
+            break;
+        }
+        if (0 == n) {
+            break;
+        }
+
+        if (NULL != tee) {
+            tee(thiz->buf, (size_t) n, tee_data);
+        }
+
+        // keep draining on error, otherwise the writers are blocked
+        if (0 == rc && 0 != thiz->codec->write(thiz->state, thiz->buf, (size_t) n)) {
+            LOGD("failed to compress: %s", strerror(errno));
+            rc = -1;
+        }
+
+        // a short read means the pipe is drained, which is flushed as the process might be killed before more is written
+        if (0 == rc && (size_t) n < sizeof(thiz->buf) && 0 != thiz->codec->flush(thiz->state)) {
+            LOGD("failed to flush: %s", strerror(errno));
+            rc = -1;
+        }
+    }
+
+    if (0 == rc) {
+        rc = thiz->codec->end(thiz->state);
+    }
+
+    return rc;
+}
+
+static void* io_compressor_run(void* args) {
+    io_compressor_t* thiz = args;
+    int rc;
+
+    for (;;) {
+        pthread_mutex_lock(&thiz->mutex);
+        while (thiz->in < 0) {
+            pthread_cond_wait(&thiz->cond, &thiz->mutex);
+        }
+        pthread_mutex_unlock(&thiz->mutex);
+
+        rc = io_compressor_run_stream(thiz);
+
+        pthread_mutex_lock(&thiz->mutex);
+        close(thiz->in);
+        thiz->in = -1;
+        thiz->rc = rc;
+        thiz->done = 1;
+        pthread_cond_broadcast(&thiz->cond);
+        pthread_mutex_unlock(&thiz->mutex);
+    }
+
+    return NULL;
+}
+
+io_compressor_t* io_compressor_create(const io_codec_t* codec) {
+    io_compressor_t* thiz;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int rc;
+
+    if (NULL == (thiz = calloc(1, sizeof(io_compressor_t)))) {
+        return NULL;
+    }
+
+    thiz->codec = codec;
+    thiz->in = -1;
+    thiz->out = -1;
+    thiz->writer = -1;
+    pthread_mutex_init(&thiz->mutex, NULL);
+    pthread_cond_init(&thiz->cond, NULL);
+
+    if (NULL == (thiz->state = codec->create())) {
+        goto error;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, io_compressor_run, thiz);
+    pthread_attr_destroy(&attr);
+
+    if (0 != rc) {
+        codec->destroy(thiz->state);
+        goto error;
+    }
+
+    pthread_setname_np(thread, "TraceCompressor");
+    return thiz;
+
+error:
+    pthread_cond_destroy(&thiz->cond);
+    pthread_mutex_destroy(&thiz->mutex);
+    free(thiz);
+    return NULL;
+}
+
+const char* io_compressor_get_suffix(io_compressor_t* thiz) {
+    return thiz->codec->suffix;
+}
+
+int io_compressor_begin(io_compressor_t* thiz, int out) {
+    int pipefd[2];
+
+    if (thiz->writer >= 0 || 0 != pipe2(pipefd, O_CLOEXEC)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&thiz->mutex);
+    thiz->out = out;
+    thiz->done = 0;
+    thiz->waiting = 0;
+    thiz->tee = NULL;
+    thiz->tee_data = NULL;
+    thiz->in = pipefd[0];
+    thiz->writer = pipefd[1];
+    pthread_cond_broadcast(&thiz->cond);
+    pthread_mutex_unlock(&thiz->mutex);
+
+    return thiz->writer;
+}
+
+void io_compressor_tee(io_compressor_t* thiz, io_compressor_tee_t tee, void* data) {
+    int n = 0;
+
+    pthread_mutex_lock(&thiz->mutex);
+
+    // the pipe is drained if the stream is waiting for it with nothing left, or the size is unknown
+    while (thiz->in >= 0 && !thiz->done && !(thiz->waiting && (0 != ioctl(thiz->writer, FIONREAD, &n) || 0 == n))) {
+        pthread_cond_wait(&thiz->cond, &thiz->mutex);
+    }
+
+    thiz->tee = tee;
+    thiz->tee_data = data;
+    pthread_mutex_unlock(&thiz->mutex);
+}
+
+int io_compressor_end(io_compressor_t* thiz) {
+    int rc;
+
+    if (thiz->writer < 0) {
+        return -1;
+    }
+
+    close(thiz->writer);
+    thiz->writer = -1;
+
+    pthread_mutex_lock(&thiz->mutex);
+    while (!thiz->done) {
+        pthread_cond_wait(&thiz->cond, &thiz->mutex);
+    }
+    rc = thiz->rc;
+    close(thiz->out);
+    thiz->out = -1;
+    pthread_mutex_unlock(&thiz->mutex);
+
+    return rc;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
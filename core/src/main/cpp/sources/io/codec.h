@@ -0,0 +1,86 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A streaming codec, the state is created ahead and reused by every stream, so that the memory is bounded
+ */
+typedef struct io_codec {
+    /* the suffix of file name, e.g. ".gz" */
+    const char* suffix;
+
+    void* (*create)(void);
+
+    /**
+     * Start a stream written to <code>fd</code>
+     */
+    int (*begin)(void* state, int fd);
+
+    int (*write)(void* state, const void* data, size_t size);
+
+    /**
+     * Write everything encoded so far to the descriptor, so that it's decodable up to here if the process dies
+     */
+    int (*flush)(void* state);
+
+    /**
+     * Finish the stream, the descriptor isn't closed
+     */
+    int (*end)(void* state);
+
+    void (*destroy)(void* state);
+} io_codec_t;
+
+/**
+ * The gzip codec of the platform zlib
+ */
+extern const io_codec_t io_codec_gzip;
+
+/**
+ * A compressor encodes everything written to its pipe on a background thread
+ */
+typedef struct io_compressor io_compressor_t;
+
+io_compressor_t* io_compressor_create(const io_codec_t* codec);
+
+/**
+ * @return the suffix of codec
+ */
+const char* io_compressor_get_suffix(io_compressor_t* thiz);
+
+/**
+ * Start compressing into <code>out</code>, which is owned by the compressor since then
+ *
+ * @return the write end of pipe, which is closed by <code>io_compressor_end</code>, or <code>-1</code> if failed
+ */
+int io_compressor_begin(io_compressor_t* thiz, int out);
+
+/**
+ * The receiver of data read from the pipe, which is called on the background thread
+ */
+typedef void (*io_compressor_tee_t)(const void* chunk, size_t size, void* data);
+
+/**
+ * Pass the data written to the pipe since then to <code>tee</code> as well, or stop it with <code>NULL</code>,
+ * it returns once the pipe is drained, so that the data written before aren't affected
+ */
+void io_compressor_tee(io_compressor_t* thiz, io_compressor_tee_t tee, void* data);
+
+/**
+ * Close the write end of pipe, wait for the stream to finish, then close <code>out</code>,
+ * all of the duplicates of the write end must be closed already
+ *
+ * @return 0 if succeeded
+ */
+int io_compressor_end(io_compressor_t* thiz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CODEC_H */
@@ -1,9 +1,12 @@
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/param.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include "file.h"
 
@@ -14,6 +17,8 @@
 extern "C" {
 #endif
 
+#define FILE_COPY_CHUNK_SIZE (1U << 20)
+
 int file_open_dev_null() {
     static int fd = -1;
     return fd > -1 ? fd : (fd = TEMP_FAILURE_RETRY(open("/dev/null", O_RDWR)));
@@ -53,8 +58,213 @@ int64_t file_get_fd_size(int fd) {
 }
 
 ssize_t file_read_fd_fully(int fd, char* content, size_t cap) {
-    size_t size = MAX((size_t) file_get_fd_size(fd), cap);
-    return TEMP_FAILURE_RETRY(read(fd, content, size));
+    size_t n = 0;
+    ssize_t rc;
+
+    // procfs reports size 0, and might return less than requested before EOF
+    while (n < cap) {
+        if (0 > (rc = TEMP_FAILURE_RETRY(read(fd, content + n, cap - n)))) {
+            return -1;
+        }
+        if (0 == rc) {
+            break;
+        }
+        n += (size_t) rc;
+    }
+
+    return (ssize_t) n;
+}
+
+ssize_t file_read_fd_chunks(int fd, char* buf, size_t size, size_t cap, file_chunk_visitor_t visit, void* data) {
+    size_t total = 0;
+    size_t want;
+    ssize_t n;
+
+    if (0 == size) {
+        return -1;
+    }
+
+    while (total < cap) {
+        want = MIN(size, cap - total);
+        if (0 > (n = file_read_fd_fully(fd, buf, want))) {
+            return -1;
+        }
+        if (0 == n) {
+            break;
+        }
+
+        total += (size_t) n;
+
+        // a short chunk means EOF
+        if (0 != visit(buf, (size_t) n, data) || (size_t) n < want) {
+            break;
+        }
+    }
+
+    return (ssize_t) total;
+}
+
+ssize_t file_read_chunks(const char* path, char* buf, size_t size, size_t cap, file_chunk_visitor_t visit, void* data) {
+    int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return -1;
+    }
+
+    ssize_t n = file_read_fd_chunks(fd, buf, size, cap, visit, data);
+    close(fd);
+    return n;
+}
+
+/**
+ * The errors meaning the way of copying isn't supported by the kernel, the file systems or the sandbox
+ */
+static int file_copy_unsupported(int error) {
+    return ENOSYS == error || EXDEV == error || EINVAL == error || EPERM == error || EOPNOTSUPP == error || ESPIPE == error;
+}
+
+/**
+ * Copy until EOF with <code>copy</code>, which advances the offsets
+ *
+ * @return 0 if it reached EOF, 1 if it's unsupported, otherwise <code>-1</code>
+ */
+static int file_copy_with(int in, int out, ssize_t (*copy)(int in, int out, size_t len), int64_t* total) {
+    ssize_t n;
+
+    for (;;) {
+        if (0 > (n = TEMP_FAILURE_RETRY(copy(in, out, FILE_COPY_CHUNK_SIZE)))) {
+            return file_copy_unsupported(errno) ? 1 : -1;
+        }
+        if (0 == n) {
+            return 0;
+        }
+        *total += n;
+    }
+}
+
+static ssize_t file_copy_file_range(int in, int out, size_t len) {
+    return (ssize_t) syscall(__NR_copy_file_range, in, NULL, out, NULL, len, 0);
+}
+
+static ssize_t file_sendfile(int in, int out, size_t len) {
+    return sendfile(out, in, NULL, len);
+}
+
+static ssize_t file_read_write(int in, int out, size_t len) {
+    char buf[8192];
+    ssize_t n;
+    ssize_t w;
+
+    if (0 >= (n = TEMP_FAILURE_RETRY(read(in, buf, MIN(len, sizeof(buf)))))) {
+        return n;
+    }
+
+    for (ssize_t off = 0; off < n; off += w) {
+        if (0 > (w = TEMP_FAILURE_RETRY(write(out, buf + off, (size_t) (n - off))))) {
+            return -1;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Splice through a pipe, since one end of splice must be a pipe
+ */
+static int file_splice(int in, int out, int64_t* total) {
+    int pipefd[2];
+    ssize_t n;
+    ssize_t w;
+    int rc = 0;
+
+    if (0 != pipe2(pipefd, O_CLOEXEC)) {
+        return 1;
+    }
+
+    for (;;) {
+        if (0 > (n = TEMP_FAILURE_RETRY(splice(in, NULL, pipefd[1], NULL, FILE_COPY_CHUNK_SIZE, SPLICE_F_MOVE)))) {
+            rc = file_copy_unsupported(errno) ? 1 : -1;
+            break;
+        }
+        if (0 == n) {
+            break;
+        }
+
+        // the data in pipe must be drained, otherwise it's lost
+        for (; n > 0; n -= w) {
+            if (0 > (w = TEMP_FAILURE_RETRY(splice(pipefd[0], NULL, out, NULL, (size_t) n, SPLICE_F_MOVE)))) {
+                rc = -1;
+                goto done;
+            }
+            *total += w;
+        }
+    }
+
+done:
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return rc;
+}
+
+int64_t file_copy_fd(int in, int out) {
+    int64_t total = 0;
+    int rc;
+
+    // copy_file_range returns 0 rather than failing for procfs, so it's continued by the others if nothing copied
+    rc = file_copy_with(in, out, file_copy_file_range, &total);
+    if (1 == rc || (0 == rc && 0 == total)) {
+        rc = file_copy_with(in, out, file_sendfile, &total);
+    }
+    if (1 == rc) {
+        rc = file_splice(in, out, &total);
+    }
+    if (1 == rc) {
+        rc = file_copy_with(in, out, file_read_write, &total);
+    }
+
+    return 0 == rc ? total : -1;
+}
+
+int64_t file_copy_to_fd(const char* path, int out) {
+    int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return -1;
+    }
+
+    int64_t n = file_copy_fd(fd, out);
+    close(fd);
+    return n;
+}
+
+int file_move(const char* from, const char* to) {
+    char tmp[PATH_MAX];
+    int out;
+
+    if (0 == rename(from, to)) {
+        return 0;
+    }
+
+    if (EXDEV != errno || (int) sizeof(tmp) <= snprintf(tmp, sizeof(tmp), "%s.tmp", to)) {
+        return -1;
+    }
+
+    if (0 > (out = TEMP_FAILURE_RETRY(open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)))) {
+        return -1;
+    }
+
+    if (0 > file_copy_to_fd(from, out) || 0 != fsync(out)) {
+        close(out);
+        unlink(tmp);
+        return -1;
+    }
+
+    close(out);
+
+    if (0 != rename(tmp, to)) {
+        unlink(tmp);
+        return -1;
+    }
+
+    return unlink(from);
 }
 
 #ifdef __cplusplus
@@ -18,8 +18,58 @@ ssize_t file_read_fully(const char* path, char* content, size_t cap);
 
 int64_t file_get_fd_size(int fd);
 
+/**
+ * Read from the current offset until EOF or <code>cap</code> bytes read, the short reads are continued
+ *
+ * @return the number of bytes read, or <code>-1</code> if failed
+ */
 ssize_t file_read_fd_fully(int fd, char* content, size_t cap);
 
+/**
+ * The visitor of chunks, returns non-zero to stop
+ */
+typedef int (*file_chunk_visitor_t)(const char* chunk, size_t size, void* data);
+
+/**
+ * Stream the file from the current offset through <code>buf</code> until EOF, <code>cap</code> bytes read or stopped
+ *
+ * @param buf the buffer of chunk
+ * @param size the size of <code>buf</code>
+ * @param cap the max number of bytes to read
+ * @param visit the visitor of chunks, which are full except the last one
+ * @return the number of bytes read, or <code>-1</code> if failed
+ */
+ssize_t file_read_fd_chunks(int fd, char* buf, size_t size, size_t cap, file_chunk_visitor_t visit, void* data);
+
+/**
+ * See <code>file_read_fd_chunks</code>
+ */
+ssize_t file_read_chunks(const char* path, char* buf, size_t size, size_t cap, file_chunk_visitor_t visit, void* data);
+
+/**
+ * Copy from the current offset of <code>in</code> to <code>out</code> until EOF without copying through user space
+ * if possible, with <code>copy_file_range</code>, <code>sendfile</code>, <code>splice</code> in order, and falls back
+ * to <code>read</code>/<code>write</code>
+ *
+ * @return the number of bytes copied, or <code>-1</code> if failed
+ */
+int64_t file_copy_fd(int in, int out);
+
+/**
+ * Copy the file into <code>out</code>, e.g. an exported descriptor
+ *
+ * @return the number of bytes copied, or <code>-1</code> if failed
+ */
+int64_t file_copy_to_fd(const char* path, int out);
+
+/**
+ * Move the file by <code>rename</code>, or copy then unlink it across file systems,
+ * the target is written to a temporary file first so that it's never seen partially
+ *
+ * @return 0 if succeeded
+ */
+int file_move(const char* from, const char* to);
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,143 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "codec.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* favor speed, the repetitive text is compressed well anyway */
+#define GZIP_LEVEL 3
+
+/* the state of deflate is (1 << (15 + 2)) + (1 << (7 + 9)), 192 KiB */
+#define GZIP_WINDOW_BITS (15 + 16)
+#define GZIP_MEM_LEVEL 7
+
+#define GZIP_BUFFER_SIZE (32 * 1024)
+
+typedef struct gzip_state {
+    z_stream stream;
+    int fd;
+    unsigned char out[GZIP_BUFFER_SIZE];
+} gzip_state_t;
+
+static int gzip_drain(gzip_state_t* thiz) {
+    size_t n = GZIP_BUFFER_SIZE - thiz->stream.avail_out;
+    ssize_t w;
+
+    for (size_t off = 0; off < n; off += (size_t) w) {
+        if (0 > (w = TEMP_FAILURE_RETRY(write(thiz->fd, thiz->out + off, n - off)))) {
+            return -1;
+        }
+    }
+
+    thiz->stream.next_out = thiz->out;
+    thiz->stream.avail_out = GZIP_BUFFER_SIZE;
+    return 0;
+}
+
+static void* gzip_create(void) {
+    gzip_state_t* thiz = calloc(1, sizeof(gzip_state_t));
+
+    if (NULL != thiz && Z_OK != deflateInit2(&thiz->stream, GZIP_LEVEL, Z_DEFLATED, GZIP_WINDOW_BITS, GZIP_MEM_LEVEL, Z_DEFAULT_STRATEGY)) {
+        free(thiz);
+        return NULL;
+    }
+
+    return thiz;
+}
+
+static int gzip_begin(void* state, int fd) {
+    gzip_state_t* thiz = state;
+
+    thiz->fd = fd;
+    thiz->stream.next_out = thiz->out;
+    thiz->stream.avail_out = GZIP_BUFFER_SIZE;
+    return Z_OK == deflateReset(&thiz->stream) ? 0 : -1;
+}
+
+static int gzip_write(void* state, const void* data, size_t size) {
+    gzip_state_t* thiz = state;
+
+    thiz->stream.next_in = (Bytef*) (uintptr_t) data;
+    thiz->stream.avail_in = (uInt) size;
+
+    while (thiz->stream.avail_in > 0) {
+        if (Z_STREAM_ERROR == deflate(&thiz->stream, Z_NO_FLUSH)) {
+            return -1;
+        }
+        if (0 == thiz->stream.avail_out && 0 != gzip_drain(thiz)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int gzip_flush(void* state) {
+    gzip_state_t* thiz = state;
+    uInt avail;
+
+    // all of the pending output is produced once deflate leaves room in the buffer
+    do {
+        if (Z_STREAM_ERROR == deflate(&thiz->stream, Z_SYNC_FLUSH)) {
+            return -1;
+        }
+        avail = thiz->stream.avail_out;
+        if (0 != gzip_drain(thiz)) {
+            return -1;
+        }
+    } while (0 == avail);
+
+    return 0;
+}
+
+static int gzip_end(void* state) {
+    gzip_state_t* thiz = state;
+    int rc;
+
+    thiz->stream.next_in = NULL;
+    thiz->stream.avail_in = 0;
+
+    do {
+        if (Z_STREAM_ERROR == (rc = deflate(&thiz->stream, Z_FINISH)) || 0 != gzip_drain(thiz)) {
+            return -1;
+        }
+    } while (Z_STREAM_END != rc);
+
+    return 0;
+}
+
+static void gzip_destroy(void* state) {
+    gzip_state_t* thiz = state;
+
+    if (NULL != thiz) {
+        deflateEnd(&thiz->stream);
+        free(thiz);
+    }
+}
+
+const io_codec_t io_codec_gzip = {
+    .suffix = ".gz",
+    .create = gzip_create,
+    .begin = gzip_begin,
+    .write = gzip_write,
+    .flush = gzip_flush,
+    .end = gzip_end,
+    .destroy = gzip_destroy,
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,339 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "journal.h"
+#include "log.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* "GRFJ" */
+#define JOURNAL_MAGIC 0x4a465247U
+
+/* "GRFR" */
+#define JOURNAL_RECORD_MAGIC 0x52465247U
+
+#define JOURNAL_VERSION 1
+
+#define JOURNAL_HEADER_SIZE 64
+
+/* the rest of ring is skipped, and the next record is at the beginning */
+#define JOURNAL_TAG_WRAP 0
+
+#define JOURNAL_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+typedef struct io_journal_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+
+    /* the offset of the oldest record in the high 32 bits, and its sequence in the low 32 bits */
+    _Atomic uint64_t tail;
+} io_journal_header_t;
+
+/**
+ * The header of record, followed by the data
+ */
+typedef struct io_journal_entry {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t tag;
+    uint32_t size;
+    uint64_t id;
+    uint32_t reserved;
+
+    /* CRC32 of the fields above and the data */
+    uint32_t crc;
+} io_journal_entry_t;
+
+struct io_journal {
+    int fd;
+    uint8_t* map;
+    size_t map_size;
+    io_journal_header_t* header;
+    uint8_t* data;
+    size_t capacity;
+
+    /* the offset and sequence of the next record */
+    size_t head;
+    uint32_t seq;
+
+    /* the oldest record, which is empty if its sequence is the next one */
+    size_t tail;
+    uint32_t tail_seq;
+};
+
+static uint32_t io_journal_checksum(const io_journal_entry_t* entry, const void* data) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    crc = crc32(crc, (const Bytef*) entry, (uInt) offsetof(io_journal_entry_t, crc));
+    if (entry->size > 0) {
+        crc = crc32(crc, data, entry->size);
+    }
+
+    return (uint32_t) crc;
+}
+
+/**
+ * Get the intact record of <code>seq</code> at <code>pos</code>, the wrap is followed, and <code>pos</code> is
+ * updated to the offset of record
+ *
+ * @return the record, or <code>NULL</code> if there's no such one
+ */
+static const io_journal_entry_t* io_journal_get(const io_journal_t* thiz, size_t* pos, uint32_t seq) {
+    const io_journal_entry_t* entry;
+    size_t p = *pos;
+
+    for (int wrapped = 0; wrapped < 2; wrapped++, p = 0) {
+        if (p > thiz->capacity || thiz->capacity - p < sizeof(io_journal_entry_t)) {
+            continue;
+        }
+
+        entry = (const void*) (thiz->data + p);
+        if (JOURNAL_RECORD_MAGIC != entry->magic
+                || seq != entry->seq
+                || entry->size > thiz->capacity - p - sizeof(io_journal_entry_t)
+                || entry->crc != io_journal_checksum(entry, entry + 1)) {
+            return NULL;
+        }
+
+        if (JOURNAL_TAG_WRAP != entry->tag) {
+            *pos = p;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static size_t io_journal_next(size_t pos, const io_journal_entry_t* entry) {
+    return pos + JOURNAL_ALIGN(sizeof(io_journal_entry_t) + entry->size);
+}
+
+/**
+ * Walk the records from the tail
+ *
+ * @return the value returned by <code>visit</code> if stopped, otherwise 0
+ */
+static int io_journal_walk(io_journal_t* thiz, io_journal_visitor_t visit, void* data, size_t* end, uint32_t* end_seq) {
+    const io_journal_entry_t* entry;
+    io_journal_record_t record;
+    size_t pos = thiz->tail;
+    uint32_t seq = thiz->tail_seq;
+    int rc = 0;
+
+    while (NULL != (entry = io_journal_get(thiz, &pos, seq))) {
+        if (NULL != visit) {
+            record.seq = entry->seq;
+            record.tag = entry->tag;
+            record.id = entry->id;
+            record.data = entry + 1;
+            record.size = entry->size;
+            if (0 != (rc = visit(&record, data))) {
+                break;
+            }
+        }
+
+        pos = io_journal_next(pos, entry);
+        seq++;
+    }
+
+    if (NULL != end) {
+        *end = pos;
+        *end_seq = seq;
+    }
+
+    return rc;
+}
+
+static void io_journal_store_tail(io_journal_t* thiz) {
+    atomic_store_explicit(&thiz->header->tail, (uint64_t) thiz->tail << 32 | thiz->tail_seq, memory_order_release);
+
+    // the death of process is the only observer, so it's enough to keep the records written after it
+    atomic_signal_fence(memory_order_seq_cst);
+}
+
+/**
+ * Drop the records in [from, to) which are going to be overwritten, the tail is stored ahead of writing,
+ * otherwise the reader might start from a partial record
+ */
+static void io_journal_drop(io_journal_t* thiz, size_t from, size_t to) {
+    const io_journal_entry_t* entry;
+    size_t pos;
+
+    while (thiz->tail_seq != thiz->seq) {
+        pos = thiz->tail;
+        if (NULL == (entry = io_journal_get(thiz, &pos, thiz->tail_seq))) {
+            // never happens unless the file is modified by others
+            thiz->tail_seq = thiz->seq;
+            break;
+        }
+
+        thiz->tail = pos;
+        if (pos < from || pos >= to) {
+            break;
+        }
+
+        thiz->tail = io_journal_next(pos, entry);
+        thiz->tail_seq++;
+    }
+
+    if (thiz->tail_seq == thiz->seq) {
+        thiz->tail = from;
+    }
+
+    io_journal_store_tail(thiz);
+}
+
+static void io_journal_put(io_journal_t* thiz, size_t pos, uint32_t tag, uint64_t id, const void* data, size_t size) {
+    io_journal_entry_t* entry = (void*) (thiz->data + pos);
+    io_journal_entry_t header = {
+        .magic = JOURNAL_RECORD_MAGIC,
+        .seq = thiz->seq,
+        .tag = tag,
+        .size = (uint32_t) size,
+        .id = id,
+    };
+
+    if (size > 0) {
+        memcpy(entry + 1, data, size);
+    }
+
+    // a partial header fails the checksum as well as a partial data
+    header.crc = io_journal_checksum(&header, data);
+    memcpy(entry, &header, sizeof(header));
+}
+
+io_journal_t* io_journal_open(const char* path, size_t capacity) {
+    io_journal_t* thiz;
+    struct stat st;
+    uint64_t tail;
+    int fresh;
+
+    capacity = JOURNAL_ALIGN(capacity);
+    if (capacity < sizeof(io_journal_entry_t) || capacity > UINT32_MAX) {
+        return NULL;
+    }
+
+    if (NULL == (thiz = calloc(1, sizeof(io_journal_t)))) {
+        return NULL;
+    }
+
+    thiz->map = MAP_FAILED;
+    thiz->map_size = JOURNAL_HEADER_SIZE + capacity;
+    thiz->capacity = capacity;
+
+    if (0 > (thiz->fd = TEMP_FAILURE_RETRY(open(path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR)))
+            || 0 != fstat(thiz->fd, &st)) {
+        goto error;
+    }
+
+    if ((fresh = (size_t) st.st_size != thiz->map_size) && 0 != ftruncate(thiz->fd, (off_t) thiz->map_size)) {
+        goto error;
+    }
+
+    // allocate the blocks ahead, otherwise writing to the mapping raises SIGBUS if the disk is full
+    if (0 != fallocate(thiz->fd, 0, 0, (off_t) thiz->map_size) && EOPNOTSUPP != errno) {
+        goto error;
+    }
+
+    thiz->map = mmap(NULL, thiz->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, thiz->fd, 0);
+    if (MAP_FAILED == thiz->map) {
+        goto error;
+    }
+
+    thiz->header = (void*) thiz->map;
+    thiz->data = thiz->map + JOURNAL_HEADER_SIZE;
+
+    if (fresh || JOURNAL_MAGIC != thiz->header->magic || JOURNAL_VERSION != thiz->header->version || capacity != thiz->header->capacity) {
+        // the stale records must not be taken as the new ones
+        memset(thiz->map, 0, thiz->map_size);
+        thiz->header->version = JOURNAL_VERSION;
+        thiz->header->capacity = capacity;
+        atomic_store(&thiz->header->tail, 0);
+        thiz->header->magic = JOURNAL_MAGIC;
+    }
+
+    tail = atomic_load_explicit(&thiz->header->tail, memory_order_acquire);
+    thiz->tail = (size_t) (tail >> 32);
+    thiz->tail_seq = (uint32_t) tail;
+    if (thiz->tail >= capacity || 0 != thiz->tail % 8) {
+        thiz->tail = 0;
+    }
+
+    // the head isn't stored, as the records written after the tail are found by their sequences
+    io_journal_walk(thiz, NULL, NULL, &thiz->head, &thiz->seq);
+    return thiz;
+
+error:
+    LOGD("failed to open journal %s : %s", path, strerror(errno));
+    io_journal_close(&thiz);
+    return NULL;
+}
+
+int io_journal_append(io_journal_t* thiz, uint32_t tag, uint64_t id, const void* data, size_t size) {
+    size_t len = JOURNAL_ALIGN(sizeof(io_journal_entry_t) + size);
+    size_t pos = thiz->head;
+
+    if (JOURNAL_TAG_WRAP == tag || len > thiz->capacity) {
+        return -1;
+    }
+
+    if (thiz->capacity - pos < len) {
+        // the rest is skipped, so are the records in it
+        io_journal_drop(thiz, pos, thiz->capacity);
+        if (thiz->capacity - pos >= sizeof(io_journal_entry_t)) {
+            io_journal_put(thiz, pos, JOURNAL_TAG_WRAP, 0, NULL, 0);
+        }
+        pos = 0;
+    }
+
+    io_journal_drop(thiz, pos, pos + len);
+    io_journal_put(thiz, pos, tag, id, data, size);
+    thiz->head = pos + len;
+    thiz->seq++;
+    return 0;
+}
+
+int io_journal_foreach(io_journal_t* thiz, io_journal_visitor_t visit, void* data) {
+    return io_journal_walk(thiz, visit, data, NULL, NULL);
+}
+
+void io_journal_clear(io_journal_t* thiz) {
+    thiz->tail = thiz->head;
+    thiz->tail_seq = thiz->seq;
+    io_journal_store_tail(thiz);
+}
+
+void io_journal_close(io_journal_t** thiz) {
+    if (NULL == thiz || NULL == *thiz) {
+        return;
+    }
+
+    if (MAP_FAILED != (*thiz)->map) {
+        munmap((*thiz)->map, (*thiz)->map_size);
+    }
+    if ((*thiz)->fd >= 0) {
+        close((*thiz)->fd);
+    }
+    free(*thiz);
+    *thiz = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
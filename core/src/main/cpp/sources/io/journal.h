@@ -0,0 +1,70 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A ring of records in a pre-sized file which is mapped shared, so that the records written survive the death of
+ * process without <code>fsync</code>. Each record has a sequence and a checksum, the partially written ones are
+ * dropped while reading, and the oldest ones are overwritten once it's full.
+ *
+ * A journal isn't thread safe.
+ */
+typedef struct io_journal io_journal_t;
+
+typedef struct io_journal_record {
+    uint32_t seq;
+    uint32_t tag;
+    uint64_t id;
+    const void* data;
+    size_t size;
+} io_journal_record_t;
+
+/**
+ * Visit a record of journal
+ *
+ * @return non-zero to stop
+ */
+typedef int (*io_journal_visitor_t)(const io_journal_record_t* record, void* data);
+
+/**
+ * Open the journal at <code>path</code> with the records kept, or create it if it's missing or of another capacity.
+ * The file is allocated and mapped ahead, nothing is allocated while appending.
+ *
+ * @param capacity the bytes of records, which is up to 4 GiB
+ */
+io_journal_t* io_journal_open(const char* path, size_t capacity);
+
+/**
+ * Append a record, the oldest records are dropped if there's no room
+ *
+ * @param tag the type of record, which must be non-zero
+ * @param id the owner of record defined by the caller
+ * @return 0 if succeeded, or <code>-1</code> if it's larger than the journal
+ */
+int io_journal_append(io_journal_t* thiz, uint32_t tag, uint64_t id, const void* data, size_t size);
+
+/**
+ * Visit the intact records from the oldest one, e.g. to recover the records left by a dead process
+ *
+ * @return the value returned by <code>visit</code> if stopped, otherwise 0
+ */
+int io_journal_foreach(io_journal_t* thiz, io_journal_visitor_t visit, void* data);
+
+/**
+ * Drop all of the records
+ */
+void io_journal_clear(io_journal_t* thiz);
+
+void io_journal_close(io_journal_t** thiz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JOURNAL_H */
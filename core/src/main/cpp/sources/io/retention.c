@@ -0,0 +1,343 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "file.h"
+#include "log.h"
+#include "retention.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* "GRFI" */
+#define RETENTION_MAGIC 0x49465247U
+
+#define RETENTION_VERSION 1
+
+/* the files beyond are not tracked */
+#define RETENTION_MAX_ENTRIES 1024
+
+#define RETENTION_NAME_SIZE 64
+
+typedef struct io_retention_entry {
+    char name[RETENTION_NAME_SIZE];
+    uint64_t size;
+    int64_t mtime;
+} io_retention_entry_t;
+
+/**
+ * The layout of index, the entries are in the order of age, the oldest one is the first
+ */
+typedef struct io_retention_index {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+
+    /* CRC32 of the entries */
+    uint32_t crc;
+
+    io_retention_entry_t entries[];
+} io_retention_index_t;
+
+struct io_retention {
+    int dirfd;
+    char path[RETENTION_NAME_SIZE];
+    char tmp[RETENTION_NAME_SIZE + 4];
+    io_retention_policy_t policy;
+    uint64_t bytes;
+
+    /* it's saved as is */
+    io_retention_index_t* index;
+};
+
+static size_t io_retention_index_size(uint32_t count) {
+    return sizeof(io_retention_index_t) + count * sizeof(io_retention_entry_t);
+}
+
+static uint32_t io_retention_checksum(const io_retention_index_t* index) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    return (uint32_t) crc32(crc, (const Bytef*) index->entries, (uInt) (index->count * sizeof(io_retention_entry_t)));
+}
+
+static int io_retention_load(io_retention_t* thiz) {
+    io_retention_index_t* index = thiz->index;
+    ssize_t n;
+    int fd;
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(openat(thiz->dirfd, thiz->path, O_RDONLY | O_CLOEXEC)))) {
+        return -1;
+    }
+
+    n = file_read_fd_fully(fd, (char*) index, io_retention_index_size(RETENTION_MAX_ENTRIES));
+    close(fd);
+
+    if (n < (ssize_t) sizeof(io_retention_index_t)
+            || RETENTION_MAGIC != index->magic
+            || RETENTION_VERSION != index->version
+            || index->count > RETENTION_MAX_ENTRIES
+            || (size_t) n != io_retention_index_size(index->count)
+            || index->crc != io_retention_checksum(index)) {
+        LOGD("index %s is broken", thiz->path);
+        index->count = 0;
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < index->count; i++) {
+        index->entries[i].name[RETENTION_NAME_SIZE - 1] = '\0';
+        thiz->bytes += index->entries[i].size;
+    }
+
+    return 0;
+}
+
+/**
+ * Write the index to a temporary file, then rename it, so that the index is either the old one or the new one
+ */
+static int io_retention_save(io_retention_t* thiz) {
+    io_retention_index_t* index = thiz->index;
+    size_t size;
+    ssize_t n;
+    int fd;
+
+    index->magic = RETENTION_MAGIC;
+    index->version = RETENTION_VERSION;
+    index->crc = io_retention_checksum(index);
+    size = io_retention_index_size(index->count);
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(openat(thiz->dirfd, thiz->tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)))) {
+        goto error;
+    }
+
+    n = TEMP_FAILURE_RETRY(write(fd, index, size));
+    close(fd);
+    if ((size_t) n != size || 0 != renameat(thiz->dirfd, thiz->tmp, thiz->dirfd, thiz->path)) {
+        unlinkat(thiz->dirfd, thiz->tmp, 0);
+        goto error;
+    }
+
+    return 0;
+
+error:
+    LOGD("failed to save index %s : %s", thiz->path, strerror(errno));
+    return -1;
+}
+
+static int io_retention_compare(const void* a, const void* b) {
+    const io_retention_entry_t* x = a;
+    const io_retention_entry_t* y = b;
+
+    if (x->mtime != y->mtime) {
+        return x->mtime < y->mtime ? -1 : 1;
+    }
+
+    return strcmp(x->name, y->name);
+}
+
+/**
+ * Scan the directory for the files, the oldest ones are kept if there are too many
+ */
+static int io_retention_rebuild(io_retention_t* thiz, int (*filter)(const char* name)) {
+    io_retention_index_t* index = thiz->index;
+    io_retention_entry_t* entry;
+    struct dirent* ent;
+    struct stat st;
+    size_t newest;
+    DIR* dir;
+    int fd;
+
+    if (0 > (fd = dup(thiz->dirfd)) || NULL == (dir = fdopendir(fd))) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    index->count = 0;
+    thiz->bytes = 0;
+
+    while (NULL != (ent = readdir(dir))) {
+        if (strlen(ent->d_name) >= RETENTION_NAME_SIZE
+                || 0 == filter(ent->d_name)
+                || 0 != fstatat(thiz->dirfd, ent->d_name, &st, 0)
+                || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        if (index->count < RETENTION_MAX_ENTRIES) {
+            entry = &index->entries[index->count++];
+        } else {
+            // replace the newest one if it's older
+            newest = 0;
+            for (size_t i = 1; i < index->count; i++) {
+                if (index->entries[i].mtime > index->entries[newest].mtime) {
+                    newest = i;
+                }
+            }
+            if (index->entries[newest].mtime <= st.st_mtime) {
+                continue;
+            }
+            entry = &index->entries[newest];
+            thiz->bytes -= entry->size;
+        }
+
+        snprintf(entry->name, sizeof(entry->name), "%s", ent->d_name);
+        entry->size = (uint64_t) st.st_size;
+        entry->mtime = st.st_mtime;
+        thiz->bytes += entry->size;
+    }
+
+    closedir(dir);
+
+    qsort(index->entries, index->count, sizeof(io_retention_entry_t), io_retention_compare);
+    LOGD("%" PRIu32 " files found in %s", index->count, thiz->path);
+    return io_retention_save(thiz);
+}
+
+io_retention_t* io_retention_open(const char* dir, const char* index, const io_retention_policy_t* policy, int (*filter)(const char* name)) {
+    io_retention_t* thiz;
+
+    if (strlen(index) >= RETENTION_NAME_SIZE || NULL == (thiz = calloc(1, sizeof(io_retention_t)))) {
+        return NULL;
+    }
+
+    thiz->policy = *policy;
+    snprintf(thiz->path, sizeof(thiz->path), "%s", index);
+    snprintf(thiz->tmp, sizeof(thiz->tmp), "%s.tmp", index);
+
+    if (0 > (thiz->dirfd = TEMP_FAILURE_RETRY(open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)))
+            || NULL == (thiz->index = calloc(1, io_retention_index_size(RETENTION_MAX_ENTRIES)))) {
+        LOGD("failed to open %s : %s", dir, strerror(errno));
+        io_retention_close(&thiz);
+        return NULL;
+    }
+
+    if (0 != io_retention_load(thiz) && 0 != io_retention_rebuild(thiz, filter)) {
+        LOGD("failed to index %s", dir);
+    }
+
+    return thiz;
+}
+
+/**
+ * Forget the entry at <code>i</code>, the file is deleted if <code>drop</code> is non-zero
+ */
+static void io_retention_remove(io_retention_t* thiz, size_t i, int drop) {
+    io_retention_index_t* index = thiz->index;
+    io_retention_entry_t* entry = &index->entries[i];
+
+    // it might be deleted by others
+    if (drop && 0 != unlinkat(thiz->dirfd, entry->name, 0) && ENOENT != errno) {
+        LOGD("failed to delete %s : %s", entry->name, strerror(errno));
+    }
+
+    thiz->bytes -= entry->size;
+    memmove(entry, entry + 1, (index->count - i - 1) * sizeof(io_retention_entry_t));
+    index->count--;
+}
+
+/**
+ * Delete the oldest files exceeding the policy without saving the index
+ */
+static int io_retention_evict(io_retention_t* thiz) {
+    io_retention_index_t* index = thiz->index;
+    io_retention_policy_t* policy = &thiz->policy;
+    int64_t now = (int64_t) time(NULL);
+    int deleted = 0;
+
+    while (index->count > 0) {
+        if (!(policy->max_count > 0 && index->count > policy->max_count)
+                && !(policy->max_bytes > 0 && thiz->bytes > policy->max_bytes && index->count > 1)
+                && !(policy->max_age_s > 0 && now - index->entries[0].mtime > (int64_t) policy->max_age_s)) {
+            break;
+        }
+
+        LOGD("delete %s", index->entries[0].name);
+        io_retention_remove(thiz, 0, 1);
+        deleted++;
+    }
+
+    return deleted;
+}
+
+int io_retention_add(io_retention_t* thiz, const char* name) {
+    io_retention_index_t* index = thiz->index;
+    io_retention_entry_t* entry;
+    struct stat st;
+    int deleted;
+
+    if (strlen(name) >= RETENTION_NAME_SIZE || 0 != fstatat(thiz->dirfd, name, &st, 0)) {
+        return -1;
+    }
+
+    // it's the latest one if it's tracked already
+    for (size_t i = 0; i < index->count; i++) {
+        if (0 == strcmp(name, index->entries[i].name)) {
+            io_retention_remove(thiz, i, 0);
+            break;
+        }
+    }
+
+    // make room for it
+    if (index->count == RETENTION_MAX_ENTRIES) {
+        io_retention_remove(thiz, 0, 1);
+    }
+
+    entry = &index->entries[index->count++];
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    entry->size = (uint64_t) st.st_size;
+    entry->mtime = st.st_mtime;
+    thiz->bytes += entry->size;
+
+    deleted = io_retention_evict(thiz);
+    return 0 == io_retention_save(thiz) ? deleted : -1;
+}
+
+int io_retention_enforce(io_retention_t* thiz) {
+    int deleted = io_retention_evict(thiz);
+
+    if (deleted > 0 && 0 != io_retention_save(thiz)) {
+        return -1;
+    }
+
+    return deleted;
+}
+
+uint64_t io_retention_get_bytes(io_retention_t* thiz) {
+    return thiz->bytes;
+}
+
+size_t io_retention_get_count(io_retention_t* thiz) {
+    return thiz->index->count;
+}
+
+void io_retention_close(io_retention_t** thiz) {
+    if (NULL == thiz || NULL == *thiz) {
+        return;
+    }
+
+    if ((*thiz)->dirfd >= 0) {
+        close((*thiz)->dirfd);
+    }
+    free((*thiz)->index);
+    free(*thiz);
+    *thiz = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,68 @@
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The retention of files in a directory, the oldest files are deleted once any of the limits is exceeded,
+ * and a limit of 0 means unlimited.
+ */
+typedef struct io_retention_policy {
+    /* the total bytes of files, the latest file is kept even if it exceeds alone */
+    uint64_t max_bytes;
+    uint32_t max_count;
+    uint32_t max_age_s;
+} io_retention_policy_t;
+
+/**
+ * The files retained are tracked by an index in the directory, so that the policy is enforced without
+ * scanning the directory, which is done only if the index is missing or broken.
+ *
+ * It isn't thread safe.
+ */
+typedef struct io_retention io_retention_t;
+
+/**
+ * Load the index of files in <code>dir</code>, or build it from the files accepted by <code>filter</code>
+ *
+ * @param index the name of index in <code>dir</code>
+ * @param filter returns non-zero if the file is retained by the policy
+ */
+io_retention_t* io_retention_open(const char* dir, const char* index, const io_retention_policy_t* policy, int (*filter)(const char* name));
+
+/**
+ * Track the file of <code>name</code> in the directory as the latest one, then enforce the policy and save the index
+ *
+ * @return the number of files deleted, or <code>-1</code> if failed
+ */
+int io_retention_add(io_retention_t* thiz, const char* name);
+
+/**
+ * Delete the oldest files exceeding the policy, and save the index if any is deleted
+ *
+ * @return the number of files deleted, or <code>-1</code> if failed
+ */
+int io_retention_enforce(io_retention_t* thiz);
+
+/**
+ * Get the total bytes of the files tracked
+ */
+uint64_t io_retention_get_bytes(io_retention_t* thiz);
+
+/**
+ * Get the number of the files tracked
+ */
+size_t io_retention_get_count(io_retention_t* thiz);
+
+void io_retention_close(io_retention_t** thiz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RETENTION_H */
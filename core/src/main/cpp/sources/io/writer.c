@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "writer.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct io_writer {
+    int fd;
+
+    /* set if any write failed, the following writes are dropped */
+    int error;
+
+    /* set if the space past EOF is reserved, which is released on close */
+    int reserved;
+
+    char* buf;
+    size_t capacity;
+    size_t size;
+
+    io_writer_stats_t stats;
+};
+
+/**
+ * Write all of the vectors, which are consumed in place
+ */
+static int io_writer_writev(io_writer_t* thiz, struct iovec* iov, int iovcnt) {
+    ssize_t n;
+
+    while (iovcnt > 0) {
+        thiz->stats.syscalls++;
+        if (0 > (n = TEMP_FAILURE_RETRY(writev(thiz->fd, iov, iovcnt)))) {
+            thiz->error = errno;
+            return -1;
+        }
+        thiz->stats.bytes += (uint64_t) n;
+
+        for (; iovcnt > 0 && (size_t) n >= iov->iov_len; iov++, iovcnt--) {
+            n -= (ssize_t) iov->iov_len;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= (size_t) n;
+        }
+    }
+
+    return 0;
+}
+
+io_writer_t* io_writer_create(size_t capacity) {
+    long page = sysconf(_SC_PAGESIZE);
+    io_writer_t* thiz;
+
+    if (NULL == (thiz = calloc(1, sizeof(io_writer_t)))) {
+        return NULL;
+    }
+
+    thiz->fd = -1;
+    thiz->capacity = (capacity + (size_t) page - 1) & ~((size_t) page - 1);
+    thiz->buf = mmap(NULL, thiz->capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+    if (MAP_FAILED == thiz->buf) {
+        free(thiz);
+        return NULL;
+    }
+
+    return thiz;
+}
+
+int io_writer_open(io_writer_t* thiz, int fd, off_t reserve) {
+    thiz->fd = fd;
+    thiz->error = 0;
+    thiz->reserved = 0;
+    thiz->size = 0;
+    memset(&thiz->stats, 0, sizeof(thiz->stats));
+
+    // best effort, not every file system supports it
+    if (reserve > 0 && fd >= 0) {
+        thiz->stats.syscalls++;
+        thiz->reserved = 0 == fallocate(fd, FALLOC_FL_KEEP_SIZE, lseek(fd, 0, SEEK_CUR), reserve);
+    }
+
+    return fd < 0 ? -1 : 0;
+}
+
+int io_writer_write(io_writer_t* thiz, const void* data, size_t size) {
+    struct iovec iov[2];
+
+    if (0 != thiz->error || thiz->fd < 0) {
+        return -1;
+    }
+
+    if (size <= thiz->capacity - thiz->size) {
+        memcpy(thiz->buf + thiz->size, data, size);
+        thiz->size += size;
+        return 0;
+    }
+
+    iov[0].iov_base = thiz->buf;
+    iov[0].iov_len = thiz->size;
+    iov[1].iov_base = (void*) (uintptr_t) data;
+    iov[1].iov_len = size;
+    thiz->size = 0;
+    return io_writer_writev(thiz, iov, 2);
+}
+
+int io_writer_printf(io_writer_t* thiz, const char* fmt, ...) {
+    size_t avail = thiz->capacity - thiz->size;
+    va_list ap;
+    int n;
+
+    if (0 != thiz->error || thiz->fd < 0) {
+        return -1;
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(thiz->buf + thiz->size, avail, fmt, ap);
+    va_end(ap);
+
+    if (n < 0) {
+        return -1;
+    }
+
+    if ((size_t) n < avail) {
+        thiz->size += (size_t) n;
+        return 0;
+    }
+
+    // make room, then format again
+    if (0 != io_writer_flush(thiz) || (size_t) n >= thiz->capacity) {
+        return -1;
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(thiz->buf, thiz->capacity, fmt, ap);
+    va_end(ap);
+
+    thiz->size = (size_t) n;
+    return 0;
+}
+
+int io_writer_flush(io_writer_t* thiz) {
+    struct iovec iov;
+
+    if (0 != thiz->error || thiz->fd < 0) {
+        return -1;
+    }
+
+    if (0 == thiz->size) {
+        return 0;
+    }
+
+    iov.iov_base = thiz->buf;
+    iov.iov_len = thiz->size;
+    thiz->size = 0;
+    return io_writer_writev(thiz, &iov, 1);
+}
+
+int io_writer_close(io_writer_t* thiz, io_writer_stats_t* stats) {
+    int rc = io_writer_flush(thiz);
+    struct stat st;
+
+    // truncating to the current size frees the blocks reserved past EOF, which are kept after close otherwise
+    if (thiz->reserved && 0 == fstat(thiz->fd, &st)) {
+        thiz->stats.syscalls++;
+        if (0 != ftruncate(thiz->fd, st.st_size)) {
+            rc = -1;
+        }
+    }
+    thiz->reserved = 0;
+
+    if (NULL != stats) {
+        *stats = thiz->stats;
+    }
+
+    thiz->fd = -1;
+    thiz->size = 0;
+    return rc;
+}
+
+void io_writer_destroy(io_writer_t** thiz) {
+    if (NULL == thiz || NULL == *thiz) {
+        return;
+    }
+
+    munmap((*thiz)->buf, (*thiz)->capacity);
+    free(*thiz);
+    *thiz = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,78 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A buffered writer with a preallocated page-aligned buffer, which coalesces the small writes into
+ * large <code>write</code>/<code>writev</code> calls, so that a trace is written with a few syscalls.
+ *
+ * A writer isn't thread safe.
+ */
+typedef struct io_writer io_writer_t;
+
+typedef struct io_writer_stats {
+    /* the bytes written to the descriptor */
+    uint64_t bytes;
+
+    /* the number of write, writev, fallocate and ftruncate calls */
+    uint32_t syscalls;
+} io_writer_stats_t;
+
+/**
+ * Create a writer with the buffer of <code>capacity</code> bytes, which is rounded up to pages
+ */
+io_writer_t* io_writer_create(size_t capacity);
+
+/**
+ * Start writing to <code>fd</code>, the statistics are reset
+ *
+ * @param reserve the bytes reserved by <code>fallocate</code> without changing the file size, 0 to skip,
+ *        the unused part is released on close
+ * @return 0 if succeeded
+ */
+int io_writer_open(io_writer_t* thiz, int fd, off_t reserve);
+
+/**
+ * Write <code>data</code>, which is buffered if it fits, otherwise written along with the buffer by one <code>writev</code>
+ *
+ * @return 0 if succeeded
+ */
+int io_writer_write(io_writer_t* thiz, const void* data, size_t size);
+
+/**
+ * Format into the buffer
+ *
+ * @return 0 if succeeded
+ */
+__attribute__((format(printf, 2, 3)))
+int io_writer_printf(io_writer_t* thiz, const char* fmt, ...);
+
+/**
+ * Write the buffered data to the descriptor, e.g. before others write to it directly
+ *
+ * @return 0 if succeeded
+ */
+int io_writer_flush(io_writer_t* thiz);
+
+/**
+ * Flush and detach from the descriptor, which isn't closed, the space reserved past EOF is released
+ *
+ * @param stats the statistics of the writing, could be <code>NULL</code>
+ * @return 0 if all written
+ */
+int io_writer_close(io_writer_t* thiz, io_writer_stats_t* stats);
+
+void io_writer_destroy(io_writer_t** thiz);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* WRITER_H */
@@ -0,0 +1,489 @@
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include "defs.h"
+#include "log.h"
+#include "hook.h"
+#include "queue.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__LP64__)
+#define ELF_R_SYM(info)  ELF64_R_SYM(info)
+#define ELF_R_TYPE(info) ELF64_R_TYPE(info)
+#else
+#define ELF_R_SYM(info)  ELF32_R_SYM(info)
+#define ELF_R_TYPE(info) ELF32_R_TYPE(info)
+#endif
+
+#if defined(__aarch64__)
+#define R_GENERIC_JUMP_SLOT R_AARCH64_JUMP_SLOT
+#define R_GENERIC_GLOB_DAT  R_AARCH64_GLOB_DAT
+#define R_GENERIC_ABS       R_AARCH64_ABS64
+#elif defined(__arm__)
+#define R_GENERIC_JUMP_SLOT R_ARM_JUMP_SLOT
+#define R_GENERIC_GLOB_DAT  R_ARM_GLOB_DAT
+#define R_GENERIC_ABS       R_ARM_ABS32
+#elif defined(__x86_64__)
+#define R_GENERIC_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define R_GENERIC_GLOB_DAT  R_X86_64_GLOB_DAT
+#define R_GENERIC_ABS       R_X86_64_64
+#elif defined(__i386__)
+#define R_GENERIC_JUMP_SLOT R_386_JMP_SLOT
+#define R_GENERIC_GLOB_DAT  R_386_GLOB_DAT
+#define R_GENERIC_ABS       R_386_32
+#else
+#error "unsupported architecture"
+#endif
+
+/* the dynamic section is relocated in place by some loaders, but not by bionic */
+#define DYN_PTR(bias, ptr) ((ptr) < (bias) ? (bias) + (ptr) : (ptr))
+
+#define HOOK_RELOCATIONS 3
+
+typedef struct hook_slot {
+    void** address;
+    void* original;
+    int prot;
+    TAILQ_ENTRY(hook_slot,) link;
+} hook_slot_t;
+
+typedef TAILQ_HEAD(hook_slots, hook_slot,) hook_slots_t;
+
+typedef struct hook {
+    regex_t regex;
+    char* pattern;
+    char* symbol;
+    void* replacement;
+    void* original;
+    hook_slots_t slots;
+    TAILQ_ENTRY(hook,) link;
+} hook_t;
+
+typedef TAILQ_HEAD(hooks, hook,) hooks_t;
+
+typedef struct hook_relocation {
+    const uint8_t* data;
+    size_t size;
+    size_t entsize;
+    int rela;
+} hook_relocation_t;
+
+/**
+ * The dynamic linking information of a loaded image
+ */
+typedef struct hook_image {
+    const char* pathname;
+    uintptr_t bias;
+    const ElfW(Phdr)* phdr;
+    ElfW(Half) phnum;
+
+    const uint8_t* sym_data;
+    size_t sym_entsize;
+    const char* str_data;
+    size_t str_size;
+
+    /* .rel[a].plt, .rela.dyn and .rel.dyn */
+    hook_relocation_t relocations[HOOK_RELOCATIONS];
+} hook_image_t;
+
+typedef struct hook_iteration {
+    hook_t* hook;
+    int restore;
+    int count;
+} hook_iteration_t;
+
+static hooks_t hooks = TAILQ_HEAD_INITIALIZER(hooks);
+
+static pthread_mutex_t hooks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int hook_load_image(hook_image_t* image, struct dl_phdr_info* info) {
+    const ElfW(Dyn)* dyn = NULL;
+    const uint8_t* jmprel = NULL;
+    size_t pltrelsz = 0;
+    ElfW(Sxword) pltrel = DT_RELA;
+    size_t relaent = sizeof(ElfW(Rela));
+    size_t relent = sizeof(ElfW(Rel));
+    uintptr_t bias = info->dlpi_addr;
+
+    memset(image, 0, sizeof(*image));
+    image->pathname = NULL == info->dlpi_name ? "" : info->dlpi_name;
+    image->bias = bias;
+    image->phdr = info->dlpi_phdr;
+    image->phnum = info->dlpi_phnum;
+
+    for (size_t i = 0; i < info->dlpi_phnum; i++) {
+        if (PT_DYNAMIC == info->dlpi_phdr[i].p_type) {
+            dyn = (const void*) (bias + info->dlpi_phdr[i].p_vaddr);
+            break;
+        }
+    }
+
+    for (; NULL != dyn && DT_NULL != dyn->d_tag; dyn++) {
+        switch (dyn->d_tag) {
+            case DT_SYMTAB:
+                image->sym_data = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+                break;
+            case DT_SYMENT:
+                image->sym_entsize = dyn->d_un.d_val;
+                break;
+            case DT_STRTAB:
+                image->str_data = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+                break;
+            case DT_STRSZ:
+                image->str_size = dyn->d_un.d_val;
+                break;
+            case DT_JMPREL:
+                jmprel = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+                break;
+            case DT_PLTRELSZ:
+                pltrelsz = dyn->d_un.d_val;
+                break;
+            case DT_PLTREL:
+                pltrel = (ElfW(Sxword)) dyn->d_un.d_val;
+                break;
+            case DT_RELA:
+                image->relocations[1].data = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+                break;
+            case DT_RELASZ:
+                image->relocations[1].size = dyn->d_un.d_val;
+                break;
+            case DT_RELAENT:
+                relaent = dyn->d_un.d_val;
+                break;
+            case DT_REL:
+                image->relocations[2].data = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+                break;
+            case DT_RELSZ:
+                image->relocations[2].size = dyn->d_un.d_val;
+                break;
+            case DT_RELENT:
+                relent = dyn->d_un.d_val;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (NULL == image->sym_data || 0 == image->sym_entsize || NULL == image->str_data || 0 == image->str_size) {
+        return -1;
+    }
+
+    image->relocations[0].data = jmprel;
+    image->relocations[0].size = pltrelsz;
+    image->relocations[0].rela = DT_RELA == pltrel;
+    image->relocations[0].entsize = DT_RELA == pltrel ? relaent : relent;
+    image->relocations[1].rela = 1;
+    image->relocations[1].entsize = relaent;
+    image->relocations[2].rela = 0;
+    image->relocations[2].entsize = relent;
+    return 0;
+}
+
+/**
+ * Returns the protection of <code>address</code> after relocation, <code>-1</code> if it's out of the image
+ */
+static int hook_get_prot(const hook_image_t* image, uintptr_t address) {
+    int prot = -1;
+
+    for (size_t i = 0; i < image->phnum; i++) {
+        const ElfW(Phdr)* phdr = &image->phdr[i];
+        uintptr_t start = image->bias + phdr->p_vaddr;
+
+        if (address < start || address >= start + phdr->p_memsz) {
+            continue;
+        }
+
+        if (PT_GNU_RELRO == phdr->p_type) {
+            return PROT_READ;
+        }
+
+        if (PT_LOAD == phdr->p_type) {
+            prot = ((phdr->p_flags & PF_R) ? PROT_READ : 0)
+                    | ((phdr->p_flags & PF_W) ? PROT_WRITE : 0)
+                    | ((phdr->p_flags & PF_X) ? PROT_EXEC : 0);
+        }
+    }
+
+    return prot;
+}
+
+/**
+ * Swap the GOT entry atomically, the page is made writable temporarily if it's read-only
+ */
+static int hook_patch(void** slot, int prot, void* value, void** old) {
+    size_t pagesize = (size_t) sysconf(_SC_PAGESIZE);
+    void* page = (void*) ((uintptr_t) slot & ~(pagesize - 1));
+
+    if (0 == (prot & PROT_WRITE) && 0 != mprotect(page, pagesize, PROT_READ | PROT_WRITE)) {
+        LOGD("mprotect %p failed: %s", page, strerror(errno));
+        return errno;
+    }
+
+    *old = __atomic_exchange_n(slot, value, __ATOMIC_SEQ_CST);
+
+    if (0 == (prot & PROT_WRITE)) {
+        mprotect(page, pagesize, prot);
+    }
+
+    return 0;
+}
+
+static int hook_match_relocation(const hook_image_t* image, const hook_relocation_t* relocation, size_t offset, const char* symbol, void*** slot) {
+    const ElfW(Rel)* rel = (const void*) (relocation->data + offset);
+    const ElfW(Sym)* sym;
+    size_t type = ELF_R_TYPE(rel->r_info);
+    size_t index = ELF_R_SYM(rel->r_info);
+
+    if (0 == index) {
+        return 0;
+    }
+
+    if (R_GENERIC_JUMP_SLOT != type && R_GENERIC_GLOB_DAT != type) {
+        // the absolute one is the same as GLOB_DAT only if there is no addend
+        if (R_GENERIC_ABS != type || !relocation->rela || 0 != ((const ElfW(Rela)*) (const void*) rel)->r_addend) {
+            return 0;
+        }
+    }
+
+    sym = (const void*) (image->sym_data + index * image->sym_entsize);
+    if (sym->st_name >= image->str_size || 0 != strcmp(image->str_data + sym->st_name, symbol)) {
+        return 0;
+    }
+
+    *slot = (void**) (image->bias + rel->r_offset);
+    return 1;
+}
+
+static int hook_is_patched(hook_t* hook, void** address) {
+    hook_slot_t* slot;
+
+    TAILQ_FOREACH(slot, &(hook->slots), link) {
+        if (slot->address == address) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int hook_apply(hook_t* hook, const hook_image_t* image) {
+    hook_slot_t* slot;
+    void** address;
+    int count = 0;
+    int prot;
+
+    for (size_t i = 0; i < HOOK_RELOCATIONS; i++) {
+        const hook_relocation_t* relocation = &image->relocations[i];
+
+        if (NULL == relocation->data || 0 == relocation->entsize) {
+            continue;
+        }
+
+        for (size_t offset = 0; offset + relocation->entsize <= relocation->size; offset += relocation->entsize) {
+            if (!hook_match_relocation(image, relocation, offset, hook->symbol, &address)
+                    || hook_is_patched(hook, address)
+                    || *address == hook->replacement
+                    || 0 > (prot = hook_get_prot(image, (uintptr_t) address))) {
+                continue;
+            }
+
+            if (NULL == (slot = calloc(1, sizeof(hook_slot_t)))) {
+                return count;
+            }
+
+            if (0 != hook_patch(address, prot, hook->replacement, &slot->original)) {
+                free(slot);
+                continue;
+            }
+
+            // the lazy binding stub lives in the image itself, which would overwrite the GOT entry once called
+            if (NULL == hook->original) {
+                hook->original = hook_get_prot(image, (uintptr_t) slot->original) < 0 ? slot->original : dlsym(RTLD_DEFAULT, hook->symbol);
+            }
+
+            slot->address = address;
+            slot->prot = prot;
+            TAILQ_INSERT_TAIL(&(hook->slots), slot, link);
+            count++;
+
+            LOGD("%s: %s@%p hooked", image->pathname, hook->symbol, (void*) address);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Restore the patched entries of image, the ones of unloaded images are never touched
+ */
+static int hook_restore(hook_t* hook, const hook_image_t* image) {
+    hook_slot_t* slot;
+    hook_slot_t* next;
+    void* old;
+    int count = 0;
+
+    TAILQ_FOREACH_SAFE(slot, &(hook->slots), link, next) {
+        if (0 > hook_get_prot(image, (uintptr_t) slot->address)) {
+            continue;
+        }
+
+        // don't break the hooks installed on top of this one
+        if (*slot->address == hook->replacement && 0 == hook_patch(slot->address, slot->prot, slot->original, &old)) {
+            count++;
+        }
+
+        TAILQ_REMOVE(&(hook->slots), slot, link);
+        free(slot);
+    }
+
+    return count;
+}
+
+static int hook_iterate_phdr(struct dl_phdr_info* info, size_t size, void* data) {
+    hook_iteration_t* iteration = data;
+    hook_image_t image;
+    hook_t* hook;
+    UNUSED(size);
+
+    if (0 != hook_load_image(&image, info)) {
+        return 0;
+    }
+
+    TAILQ_FOREACH(hook, &hooks, link) {
+        if ((NULL != iteration->hook && hook != iteration->hook) || 0 != regexec(&hook->regex, image.pathname, 0, NULL, 0)) {
+            continue;
+        }
+
+        iteration->count += iteration->restore ? hook_restore(hook, &image) : hook_apply(hook, &image);
+    }
+
+    return 0;
+}
+
+static hook_t* hook_find(const char* regex, const char* symbol) {
+    hook_t* hook;
+
+    TAILQ_FOREACH(hook, &hooks, link) {
+        if (0 == strcmp(hook->pattern, regex) && 0 == strcmp(hook->symbol, symbol)) {
+            return hook;
+        }
+    }
+    return NULL;
+}
+
+static void hook_free(hook_t* hook) {
+    hook_slot_t* slot;
+
+    while (NULL != (slot = TAILQ_FIRST(&(hook->slots)))) {
+        TAILQ_REMOVE(&(hook->slots), slot, link);
+        free(slot);
+    }
+
+    regfree(&hook->regex);
+    free(hook->pattern);
+    free(hook->symbol);
+    free(hook);
+}
+
+int hook_install(const char* regex, const char* symbol, void* replacement, void** original) {
+    hook_iteration_t iteration = { 0 };
+    hook_t* hook;
+    int rc;
+
+    if (NULL == regex || NULL == symbol || NULL == replacement) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&hooks_mutex);
+
+    if (NULL != hook_find(regex, symbol)) {
+        LOGD("%s in %s already hooked", symbol, regex);
+        pthread_mutex_unlock(&hooks_mutex);
+        return -1;
+    }
+
+    if (NULL == (hook = calloc(1, sizeof(hook_t)))) {
+        pthread_mutex_unlock(&hooks_mutex);
+        return -1;
+    }
+
+    TAILQ_INIT(&(hook->slots));
+    hook->replacement = replacement;
+
+    if (0 != (rc = regcomp(&hook->regex, regex, REG_EXTENDED | REG_NOSUB))) {
+        LOGD("invalid regex %s: %d", regex, rc);
+        free(hook);
+        pthread_mutex_unlock(&hooks_mutex);
+        return -1;
+    }
+
+    if (NULL == (hook->pattern = strdup(regex)) || NULL == (hook->symbol = strdup(symbol))) {
+        hook_free(hook);
+        pthread_mutex_unlock(&hooks_mutex);
+        return -1;
+    }
+
+    TAILQ_INSERT_TAIL(&hooks, hook, link);
+
+    iteration.hook = hook;
+    dl_iterate_phdr(hook_iterate_phdr, &iteration);
+
+    if (NULL != original) {
+        *original = NULL != hook->original ? hook->original : dlsym(RTLD_DEFAULT, symbol);
+    }
+
+    pthread_mutex_unlock(&hooks_mutex);
+    return iteration.count;
+}
+
+int hook_uninstall(const char* regex, const char* symbol) {
+    hook_iteration_t iteration = { .restore = 1 };
+    hook_t* hook;
+
+    pthread_mutex_lock(&hooks_mutex);
+
+    if (NULL == (hook = hook_find(regex, symbol))) {
+        pthread_mutex_unlock(&hooks_mutex);
+        return -1;
+    }
+
+    iteration.hook = hook;
+    dl_iterate_phdr(hook_iterate_phdr, &iteration);
+
+    TAILQ_REMOVE(&hooks, hook, link);
+    hook_free(hook);
+
+    pthread_mutex_unlock(&hooks_mutex);
+    return iteration.count;
+}
+
+int hook_refresh(void) {
+    hook_iteration_t iteration = { 0 };
+
+    pthread_mutex_lock(&hooks_mutex);
+    dl_iterate_phdr(hook_iterate_phdr, &iteration);
+    pthread_mutex_unlock(&hooks_mutex);
+
+    return iteration.count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,43 @@
+#ifndef HOOK_H
+#define HOOK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Redirect the calls to <code>symbol</code> made by the loaded libraries whose path matches <code>regex</code>
+ *
+ * The GOT entries referenced by <code>.rela.plt</code>/<code>.rel.plt</code> and <code>.rela.dyn</code>/<code>.rel.dyn</code>
+ * are swapped atomically, so the callers never see a torn pointer. The hook is remembered, and applied to the
+ * libraries loaded afterwards by <code>hook_refresh</code>.
+ *
+ * @param regex the POSIX extended regular expression of library path
+ * @param symbol the name of the imported function, e.g. <code>write</code>
+ * @param replacement the function to be called instead
+ * @param original the original function, could be <code>NULL</code>
+ * @return the number of GOT entries patched, or <code>-1</code> if failed
+ */
+int hook_install(const char* regex, const char* symbol, void* replacement, void** original);
+
+/**
+ * Restore the GOT entries patched by <code>hook_install</code> with the same <code>regex</code> and <code>symbol</code>
+ *
+ * @param regex the regular expression passed to <code>hook_install</code>
+ * @param symbol the symbol passed to <code>hook_install</code>
+ * @return the number of GOT entries restored, or <code>-1</code> if not hooked
+ */
+int hook_uninstall(const char* regex, const char* symbol);
+
+/**
+ * Apply the installed hooks to the libraries loaded since
+ *
+ * @return the number of GOT entries patched
+ */
+int hook_refresh(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOOK_H */
@@ -10,11 +10,15 @@
 #include <fcntl.h>
 #include <link.h>
 #include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "defs.h"
 #include "log.h"
 #include "linker.h"
+#include "minidebuginfo.h"
 #include "procfs.h"
 #include "queue.h"
 
@@ -26,33 +30,99 @@
 extern "C" {
 #endif
 
+#define NOTE_MAX_SIZE 1024
+
+#define ALIGN4(x) (((x) + 3) & ~((size_t) 3))
+
+#ifndef ELF_ST_TYPE
+#define ELF_ST_TYPE(info) ((info) & 0xf)
+#endif
+
+/* the dynamic section is relocated in place by some loaders, but not by bionic */
+#define DYN_PTR(bias, ptr) ((ptr) < (bias) ? (bias) + (ptr) : (ptr))
+
+/* bit 0 of st_value marks a Thumb function on ARM, which isn't a part of its address */
+#if defined(__arm__)
+#define FUNC_ADDRESS(value) ((value) & ~(ElfW(Addr)) 1)
+#else
+#define FUNC_ADDRESS(value) (value)
+#endif
+
 typedef struct shared_library_symbol {
-    /* SYMTAB section header */
-    size_t sym_offset;
+    /* SYMTAB section */
+    const uint8_t* sym_data;
     size_t sym_size;
     size_t sym_entsize;
 
-    /* STRTAB section header */
-    size_t str_offset;
+    /* STRTAB section */
+    const char* str_data;
     size_t str_size;
-    size_t str_entsize;
+
+    /* GNU_HASH / HASH section, SHT_NULL if absent */
+    uint32_t hash_type;
+    const uint32_t* hash_data;
+    size_t hash_size;
+
+    /* index of SYMTAB section header */
+    size_t index;
 
     TAILQ_ENTRY(shared_library_symbol,) link;
 } shared_library_symbol_t;
 
 typedef TAILQ_HEAD(shared_library_symbols, shared_library_symbol,) shared_library_symbols_t;
 
+/**
+ * A page aligned range of the file mapped into memory
+ */
+typedef struct shared_library_region {
+    uint8_t* data;
+    size_t offset;
+    size_t size;
+
+    TAILQ_ENTRY(shared_library_region,) link;
+} shared_library_region_t;
+
+typedef TAILQ_HEAD(shared_library_regions, shared_library_region,) shared_library_regions_t;
+
+/**
+ * An entry of the name index
+ */
+typedef struct shared_library_name {
+    const char* name;
+    uintptr_t address;
+} shared_library_name_t;
+
+/**
+ * An entry of the address index
+ */
+typedef struct shared_library_func {
+    uintptr_t address;
+    size_t size;
+    const char* name;
+} shared_library_func_t;
+
 struct shared_library {
     uintptr_t address;
     uintptr_t load_bias;
-    uint8_t* data;
     size_t size;
+    size_t pages;
+    shared_library_regions_t regions;
     shared_library_symbols_t symbols;
+    minidebuginfo_t debugdata;
+
+    /* symbols sorted by name, built on demand */
+    shared_library_name_t* names;
+    size_t nnames;
+
+    /* FUNC symbols sorted by address, built on demand */
+    shared_library_func_t* funcs;
+    size_t nfuncs;
+
     char pathname[PATH_MAX];
     int fd;
 };
 
-static int shared_library_mmap(shared_library_t* thiz) {
+static int shared_library_fopen(shared_library_t* thiz) {
     struct stat stat;
 
     if (0 > (thiz->fd = TEMP_FAILURE_RETRY(open(thiz->pathname, O_RDONLY | O_CLOEXEC)))) {
@@ -66,54 +136,236 @@ static int shared_library_mmap(shared_library_t* thiz) {
     }
 
     thiz->size = (size_t) stat.st_size;
+    return 0;
+}
 
-    if (MAP_FAILED == (thiz->data = (uint8_t*) mmap(NULL, thiz->size, PROT_READ, MAP_PRIVATE, thiz->fd, 0))) {
-        LOGD("failed to mmap %s: %s", thiz->pathname, strerror(errno));
-        return errno;
+/**
+ * Map the specified range of the file, instead of the whole file, the pages are prefetched with
+ * <code>MADV_WILLNEED</code> as they are about to be parsed
+ *
+ * @return the address of <code>offset</code> or <code>NULL</code> if error occurred
+ */
+static void* shared_library_mmap(shared_library_t* thiz, size_t offset, size_t size) {
+    shared_library_region_t* region;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start = offset & ~(page - 1);
+
+    if (0 == size || offset > thiz->size || size > thiz->size - offset) {
+        return NULL;
     }
 
-    return 0;
+    // reuse the region which already covers the range
+    TAILQ_FOREACH(region, &(thiz->regions), link) {
+        if (offset >= region->offset && offset + size <= region->offset + region->size) {
+            return region->data + (offset - region->offset);
+        }
+    }
+
+    if (NULL == (region = calloc(1, sizeof(shared_library_region_t)))) {
+        return NULL;
+    }
+
+    region->offset = start;
+    region->size = offset + size - start;
+
+    if (MAP_FAILED == (region->data = mmap(NULL, region->size, PROT_READ, MAP_PRIVATE, thiz->fd, (off_t) start))) {
+        LOGD("failed to mmap %s [%zx, %zx): %s", thiz->pathname, offset, offset + size, strerror(errno));
+        free(region);
+        return NULL;
+    }
+
+    madvise(region->data, region->size, MADV_WILLNEED);
+
+    thiz->pages += (region->size + page - 1) / page;
+    TAILQ_INSERT_TAIL(&(thiz->regions), region, link);
+    return region->data + (offset - start);
+}
+
+static const ElfW(Sym)* shared_library_get_symbol(shared_library_symbol_t* s, size_t index) {
+    if (0 == s->sym_entsize || index >= s->sym_size / s->sym_entsize) {
+        return NULL;
+    }
+    return (const void*) (s->sym_data + index * s->sym_entsize);
 }
 
-static void* shared_library_get(shared_library_t* thiz, uintptr_t offset, size_t size) {
-    if (offset + size > thiz->size) {
+static const char* shared_library_get_symbol_name(shared_library_symbol_t* s, const ElfW(Sym)* sym) {
+    if (SHN_UNDEF == sym->st_shndx) {
+        return NULL;
+    }
+
+    // .strtab / .dynstr is verified to be NUL terminated while loading
+    if (sym->st_name >= s->str_size) {
         return NULL;
     }
-    return (void*) (thiz->data + offset);
+
+    return s->str_data + sym->st_name;
 }
 
-static const char* shared_library_get_string(shared_library_t* thiz, uintptr_t offset) {
-    uint8_t* ptr = thiz->data + offset;
-    uint8_t* end = thiz->data + thiz->size;
+static int shared_library_match_symbol(shared_library_symbol_t* s, const ElfW(Sym)* sym, const char* symbol) {
+    const char* str = shared_library_get_symbol_name(s, sym);
+    return NULL != str && 0 == strcmp(symbol, str);
+}
 
-    while (ptr < end) {
-        if (*ptr == '\0') {
-            return (char*) (thiz->data + offset);
+static uint32_t elf_gnu_hash(const char* name) {
+    uint32_t h = 5381;
+    for (const uint8_t* c = (const uint8_t*) name; *c != '\0'; c++) {
+        h += (h << 5) + *c;
+    }
+    return h;
+}
+
+static uint32_t elf_sysv_hash(const char* name) {
+    uint32_t h = 0;
+    uint32_t g;
+    for (const uint8_t* c = (const uint8_t*) name; *c != '\0'; c++) {
+        h = (h << 4) + *c;
+        g = h & 0xf0000000;
+        h ^= g;
+        h ^= g >> 24;
+    }
+    return h;
+}
+
+/**
+ * Validate the hash table referenced by <code>shdr</code>, and attach it to the symbol table it indexes
+ *
+ * <pre>
+ * .gnu.hash: nbuckets, symoffset, bloom_size, bloom_shift, bloom[bloom_size], buckets[nbuckets], chain[]
+ * .hash:     nbucket, nchain, bucket[nbucket], chain[nchain]
+ * </pre>
+ */
+static void shared_library_attach_hash(shared_library_t* thiz, ElfW(Shdr)* shdr) {
+    shared_library_symbol_t* symbol;
+    uint32_t* header;
+    size_t size;
+
+    TAILQ_FOREACH(symbol, &(thiz->symbols), link) {
+        if (symbol->index == shdr->sh_link) {
+            break;
         }
-        ptr++;
     }
 
-    return NULL;
+    // prefer .gnu.hash over .hash
+    if (NULL == symbol || SHT_GNU_HASH == symbol->hash_type || shdr->sh_size < 2 * sizeof(uint32_t)) {
+        return;
+    }
+
+    if (NULL == (header = shared_library_mmap(thiz, shdr->sh_offset, shdr->sh_size))) {
+        return;
+    }
+
+    if (SHT_GNU_HASH == shdr->sh_type) {
+        if (shdr->sh_size < 4 * sizeof(uint32_t) || 0 == header[0] || 0 == header[2]) {
+            return;
+        }
+        size = 4 * sizeof(uint32_t) + header[2] * sizeof(ElfW(Addr)) + header[0] * sizeof(uint32_t);
+    } else {
+        if (0 == header[0]) {
+            return;
+        }
+        size = (2 + (size_t) header[0] + header[1]) * sizeof(uint32_t);
+    }
+
+    if (size > shdr->sh_size) {
+        LOGD("malformed hash section of %s", thiz->pathname);
+        return;
+    }
+
+    symbol->hash_type = shdr->sh_type;
+    symbol->hash_data = header;
+    symbol->hash_size = shdr->sh_size;
 }
 
-static int shared_library_load(shared_library_t* thiz) {
+/**
+ * Register the symbol table embedded in <code>.gnu_debugdata</code> section (MiniDebugInfo),
+ * which is the only source of internal symbols of the libraries without <code>.symtab</code>
+ */
+static int shared_library_load_debugdata(shared_library_t* thiz, ElfW(Ehdr)* ehdr, uint8_t* shdrs, const char* cache) {
+    ElfW(Shdr)* shdr;
+    ElfW(Shdr)* str_shdr;
+    const char* shstrtab;
+    const uint8_t* xz;
+    uint8_t build_id[64];
+    ssize_t build_id_size;
+    shared_library_symbol_t* symbol;
+
+    if (ehdr->e_shstrndx == SHN_UNDEF || ehdr->e_shstrndx >= ehdr->e_shnum) {
+        return -1;
+    }
+
+    str_shdr = (void*) (shdrs + ehdr->e_shstrndx * ehdr->e_shentsize);
+    if (0 == str_shdr->sh_size || NULL == (shstrtab = shared_library_mmap(thiz, str_shdr->sh_offset, str_shdr->sh_size))) {
+        return -1;
+    }
+
+    for (size_t i = ehdr->e_shentsize; i < ehdr->e_shnum * ehdr->e_shentsize; i += ehdr->e_shentsize) {
+        shdr = (void*) (shdrs + i);
+
+        if (SHT_PROGBITS != shdr->sh_type
+                || shdr->sh_name + sizeof(".gnu_debugdata") > str_shdr->sh_size
+                || 0 != memcmp(shstrtab + shdr->sh_name, ".gnu_debugdata", sizeof(".gnu_debugdata"))) {
+            continue;
+        }
+
+        if (NULL == (xz = shared_library_mmap(thiz, shdr->sh_offset, shdr->sh_size))) {
+            return -1;
+        }
+
+        build_id_size = shared_library_read_build_id(thiz->fd, build_id, sizeof(build_id));
+
+        if (0 != minidebuginfo_open(&thiz->debugdata, xz, shdr->sh_size, build_id, build_id_size > 0 ? (size_t) build_id_size : 0, cache)) {
+            return -1;
+        }
+
+        if (NULL == (symbol = calloc(1, sizeof(shared_library_symbol_t)))) {
+            return ENOMEM;
+        }
+
+        symbol->sym_data = thiz->debugdata.sym_data;
+        symbol->sym_size = thiz->debugdata.sym_size;
+        symbol->sym_entsize = thiz->debugdata.sym_entsize;
+
+        symbol->str_data = thiz->debugdata.str_data;
+        symbol->str_size = thiz->debugdata.str_size;
+
+        symbol->hash_type = SHT_NULL;
+        symbol->index = ehdr->e_shnum;
+
+        TAILQ_INSERT_TAIL(&(thiz->symbols), symbol, link);
+        return 0;
+    }
+
+    return -1;
+}
+
+static int shared_library_load(shared_library_t* thiz, const char* cache) {
     ElfW(Ehdr)* ehdr;
     ElfW(Phdr)* phdr;
     ElfW(Shdr)* shdr;
     ElfW(Shdr)* str_shdr;
+    uint8_t* phdrs;
+    uint8_t* shdrs;
     shared_library_symbol_t* symbol;
+    int symtab = 0;
 
     // lookup ELF header
-    if (NULL == (ehdr = shared_library_get(thiz, 0, sizeof(ElfW(Ehdr))))) {
+    if (NULL == (ehdr = shared_library_mmap(thiz, 0, sizeof(ElfW(Ehdr)))) || 0 != memcmp(ehdr->e_ident, ELFMAG, SELFMAG)) {
         LOGD("failed to locate ELF header of %s", thiz->pathname);
         return -1;
     }
 
+    if (ehdr->e_phentsize < sizeof(ElfW(Phdr)) || ehdr->e_shentsize < sizeof(ElfW(Shdr))) {
+        LOGD("malformed ELF header of %s", thiz->pathname);
+        return -1;
+    }
+
     // lookup load_bias
+    if (NULL == (phdrs = shared_library_mmap(thiz, ehdr->e_phoff, (size_t) ehdr->e_phnum * ehdr->e_phentsize))) {
+        return -1;
+    }
+
     for (size_t i = 0; i < ehdr->e_phnum * ehdr->e_phentsize; i += ehdr->e_phentsize) {
-        if (NULL == (phdr = shared_library_get(thiz, ehdr->e_phoff + i, sizeof(ElfW(Phdr))))) {
-            return -1;
-        }
+        phdr = (void*) (phdrs + i);
 
         if ((PT_LOAD == phdr->p_type) && (phdr->p_flags & PF_X) && (0 == phdr->p_offset)) {
             thiz->load_bias = phdr->p_vaddr;
@@ -122,19 +374,19 @@ static int shared_library_load(shared_library_t* thiz) {
     }
 
     // lookup symbol table
+    if (NULL == (shdrs = shared_library_mmap(thiz, ehdr->e_shoff, (size_t) ehdr->e_shnum * ehdr->e_shentsize))) {
+        return -1;
+    }
+
     for (size_t i = ehdr->e_shentsize; i < ehdr->e_shnum * ehdr->e_shentsize; i += ehdr->e_shentsize) {
-        if (NULL == (shdr = shared_library_get(thiz, ehdr->e_shoff + i, sizeof(ElfW(Shdr))))) {
-            return -1;
-        }
+        shdr = (void*) (shdrs + i);
 
         if ((SHT_SYMTAB == shdr->sh_type) || (SHT_DYNSYM == shdr->sh_type)) {
             if (shdr->sh_link >= ehdr->e_shnum) {
                 continue;
             }
 
-            if (NULL == (str_shdr = shared_library_get(thiz, ehdr->e_shoff + shdr->sh_link * ehdr->e_shentsize, sizeof(ElfW(Shdr))))) {
-                return -1;
-            }
+            str_shdr = (void*) (shdrs + shdr->sh_link * ehdr->e_shentsize);
 
             if (SHT_STRTAB != str_shdr->sh_type) {
                 continue;
@@ -144,19 +396,41 @@ static int shared_library_load(shared_library_t* thiz) {
                 return ENOMEM;
             }
 
-            symbol->sym_offset = shdr->sh_offset;
+            symbol->sym_data = shared_library_mmap(thiz, shdr->sh_offset, shdr->sh_size);
             symbol->sym_size = shdr->sh_size;
             symbol->sym_entsize = shdr->sh_entsize;
 
-            symbol->str_offset = str_shdr->sh_offset;
+            symbol->str_data = shared_library_mmap(thiz, str_shdr->sh_offset, str_shdr->sh_size);
             symbol->str_size = str_shdr->sh_size;
-            symbol->str_entsize = str_shdr->sh_entsize;
 
+            symbol->hash_type = SHT_NULL;
+            symbol->index = i / ehdr->e_shentsize;
+
+            if (NULL == symbol->sym_data || NULL == symbol->str_data || '\0' != symbol->str_data[symbol->str_size - 1]) {
+                free(symbol);
+                continue;
+            }
+
+            symtab |= SHT_SYMTAB == shdr->sh_type;
             TAILQ_INSERT_TAIL(&(thiz->symbols), symbol, link);
         }
     }
 
-    if (thiz->symbols.tqh_first == NULL && thiz->symbols.tqh_last == NULL) {
+    // lookup hash table of symbol table
+    for (size_t i = ehdr->e_shentsize; i < ehdr->e_shnum * ehdr->e_shentsize; i += ehdr->e_shentsize) {
+        shdr = (void*) (shdrs + i);
+
+        if ((SHT_GNU_HASH == shdr->sh_type) || (SHT_HASH == shdr->sh_type)) {
+            shared_library_attach_hash(thiz, shdr);
+        }
+    }
+
+    // .symtab stripped
+    if (!symtab && 0 == shared_library_load_debugdata(thiz, ehdr, shdrs, cache)) {
+        LOGD("loaded .gnu_debugdata of %s", thiz->pathname);
+    }
+
+    if (TAILQ_EMPTY(&(thiz->symbols))) {
         return -1;
     }
 
@@ -164,22 +438,34 @@ static int shared_library_load(shared_library_t* thiz) {
 }
 
 shared_library_t* shared_library_open(const char* pathname) {
+    return shared_library_open_with_cache(pathname, NULL);
+}
+
+shared_library_t* shared_library_open_with_cache(const char* pathname, const char* cache) {
+    struct rusage before;
+    struct rusage after;
+
     shared_library_t* lib = calloc(1, sizeof(shared_library_t));
     if (NULL == lib) {
         return NULL;
     }
 
     lib->fd = -1;
-    lib->data = MAP_FAILED;
     strcpy(lib->pathname, pathname);
+    TAILQ_INIT(&(lib->regions));
     TAILQ_INIT(&(lib->symbols));
 
+    getrusage(RUSAGE_THREAD, &before);
+
     if (procfs_get_map_address(pathname, &lib->address)
-            || shared_library_mmap(lib)
-            || shared_library_load(lib)) {
+            || shared_library_fopen(lib)
+            || shared_library_load(lib, cache)) {
         goto error;
     }
 
+    getrusage(RUSAGE_THREAD, &after);
+    LOGD("%s: %zu pages mapped, %ld major faults", pathname, lib->pages, after.ru_majflt - before.ru_majflt);
+
     return lib;
 
 error:
@@ -187,6 +473,141 @@ error:
     return NULL;
 }
 
+typedef struct shared_library_phdr {
+    const char* pathname;
+    ElfW(Addr) addr;
+    const ElfW(Phdr)* phdr;
+    ElfW(Half) phnum;
+} shared_library_phdr_t;
+
+static int shared_library_find_phdr(struct dl_phdr_info* info, size_t size, void* data) {
+    shared_library_phdr_t* thiz = data;
+    UNUSED(size);
+
+    if (NULL == info->dlpi_name || 0 != strcmp(info->dlpi_name, thiz->pathname)) {
+        return 0;
+    }
+
+    thiz->addr = info->dlpi_addr;
+    thiz->phdr = info->dlpi_phdr;
+    thiz->phnum = info->dlpi_phnum;
+    return 1;
+}
+
+/**
+ * Register <code>.dynsym</code> located through <code>PT_DYNAMIC</code> of the loaded image
+ */
+static int shared_library_load_dynamic(shared_library_t* thiz, const shared_library_phdr_t* phdr) {
+    const ElfW(Dyn)* dyn = NULL;
+    const uint32_t* hash = NULL;
+    const uint32_t* gnu_hash = NULL;
+    const uint32_t* buckets;
+    const uint32_t* chain;
+    uintptr_t bias = phdr->addr;
+    uintptr_t vaddr = UINTPTR_MAX;
+    size_t nsyms = 0;
+    shared_library_symbol_t* symbol;
+
+    if (NULL == (symbol = calloc(1, sizeof(shared_library_symbol_t)))) {
+        return ENOMEM;
+    }
+
+    for (size_t i = 0; i < phdr->phnum; i++) {
+        if (PT_DYNAMIC == phdr->phdr[i].p_type) {
+            dyn = (const void*) (bias + phdr->phdr[i].p_vaddr);
+        } else if (PT_LOAD == phdr->phdr[i].p_type) {
+            vaddr = MIN(vaddr, phdr->phdr[i].p_vaddr);
+        }
+    }
+
+    for (; NULL != dyn && DT_NULL != dyn->d_tag; dyn++) {
+        if (DT_SYMTAB == dyn->d_tag) {
+            symbol->sym_data = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+        } else if (DT_SYMENT == dyn->d_tag) {
+            symbol->sym_entsize = dyn->d_un.d_val;
+        } else if (DT_STRTAB == dyn->d_tag) {
+            symbol->str_data = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+        } else if (DT_STRSZ == dyn->d_tag) {
+            symbol->str_size = dyn->d_un.d_val;
+        } else if (DT_HASH == dyn->d_tag) {
+            hash = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+        } else if (DT_GNU_HASH == dyn->d_tag) {
+            gnu_hash = (const void*) DYN_PTR(bias, dyn->d_un.d_ptr);
+        }
+    }
+
+    if (NULL == symbol->sym_data || NULL == symbol->str_data || 0 == symbol->str_size || 0 == symbol->sym_entsize
+            || '\0' != symbol->str_data[symbol->str_size - 1] || UINTPTR_MAX == vaddr) {
+        free(symbol);
+        return -1;
+    }
+
+    // the number of symbols is implied by the hash table
+    if (NULL != gnu_hash && 0 != gnu_hash[0] && 0 != gnu_hash[2]) {
+        buckets = (const void*) (gnu_hash + 4 + gnu_hash[2] * (sizeof(ElfW(Addr)) / sizeof(uint32_t)));
+        chain = buckets + gnu_hash[0];
+
+        for (uint32_t i = 0; i < gnu_hash[0]; i++) {
+            nsyms = MAX(nsyms, buckets[i]);
+        }
+        if (nsyms >= gnu_hash[1]) {
+            while (0 == (chain[nsyms - gnu_hash[1]] & 1)) {
+                nsyms++;
+            }
+            nsyms++;
+        }
+        nsyms = MAX(nsyms, gnu_hash[1]);
+
+        symbol->hash_type = SHT_GNU_HASH;
+        symbol->hash_data = gnu_hash;
+        symbol->hash_size = (size_t) ((const uint8_t*) (chain + nsyms - gnu_hash[1]) - (const uint8_t*) gnu_hash);
+    } else if (NULL != hash && 0 != hash[0]) {
+        nsyms = hash[1];
+
+        symbol->hash_type = SHT_HASH;
+        symbol->hash_data = hash;
+        symbol->hash_size = (2 + (size_t) hash[0] + hash[1]) * sizeof(uint32_t);
+    } else {
+        free(symbol);
+        return -1;
+    }
+
+    symbol->sym_size = nsyms * symbol->sym_entsize;
+
+    // keep consistent with the file based one, which is relative to the first mapping
+    thiz->load_bias = vaddr & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+    thiz->address = bias + thiz->load_bias;
+
+    TAILQ_INSERT_TAIL(&(thiz->symbols), symbol, link);
+    return 0;
+}
+
+shared_library_t* shared_library_open_in_memory(const char* pathname) {
+    shared_library_phdr_t phdr = { .pathname = pathname };
+
+    if (0 == dl_iterate_phdr(shared_library_find_phdr, &phdr)) {
+        LOGD("%s not loaded", pathname);
+        return NULL;
+    }
+
+    shared_library_t* lib = calloc(1, sizeof(shared_library_t));
+    if (NULL == lib) {
+        return NULL;
+    }
+
+    lib->fd = -1;
+    strcpy(lib->pathname, pathname);
+    TAILQ_INIT(&(lib->regions));
+    TAILQ_INIT(&(lib->symbols));
+
+    if (0 != shared_library_load_dynamic(lib, &phdr)) {
+        shared_library_close(&lib);
+        return NULL;
+    }
+
+    return lib;
+}
+
 const char* shared_library_get_pathname(shared_library_t* thiz, char* buf, size_t len) {
     if (NULL == thiz || NULL == buf) {
         return NULL;
@@ -199,19 +620,70 @@ uintptr_t shared_library_get_address(shared_library_t* thiz) {
     return thiz->address;
 }
 
+ssize_t shared_library_read_build_id(int fd, uint8_t* buf, size_t size) {
+    ElfW(Ehdr) ehdr;
+    ElfW(Phdr) phdr;
+    ElfW(Nhdr) nhdr;
+    uint8_t note[NOTE_MAX_SIZE];
+    ssize_t n;
+
+    if (sizeof(ehdr) != pread(fd, &ehdr, sizeof(ehdr), 0) || 0 != memcmp(ehdr.e_ident, ELFMAG, SELFMAG)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < ehdr.e_phnum; i++) {
+        if (sizeof(phdr) != pread(fd, &phdr, sizeof(phdr), (off_t) (ehdr.e_phoff + i * ehdr.e_phentsize))) {
+            return -1;
+        }
+
+        if (PT_NOTE != phdr.p_type) {
+            continue;
+        }
+
+        if (0 > (n = pread(fd, note, MIN(sizeof(note), phdr.p_filesz), (off_t) phdr.p_offset))) {
+            return -1;
+        }
+
+        for (size_t offset = 0; offset + sizeof(nhdr) <= (size_t) n;) {
+            memcpy(&nhdr, note + offset, sizeof(nhdr));
+            size_t name = offset + sizeof(nhdr);
+            size_t desc = name + ALIGN4(nhdr.n_namesz);
+            offset = desc + ALIGN4(nhdr.n_descsz);
+
+            if (offset > (size_t) n) {
+                break;
+            }
+
+            if (NT_GNU_BUILD_ID == nhdr.n_type && 4 == nhdr.n_namesz && 0 == memcmp(note + name, "GNU", 4)) {
+                memcpy(buf, note + desc, MIN(nhdr.n_descsz, size));
+                return (ssize_t) MIN(nhdr.n_descsz, size);
+            }
+        }
+    }
+
+    return 0;
+}
+
 void shared_library_close(shared_library_t** thiz) {
     if (NULL == thiz || NULL == *thiz) {
         return;
     }
 
-    if (MAP_FAILED != (*thiz)->data) {
-        TEMP_FAILURE_RETRY(munmap((*thiz)->data, (*thiz)->size));
+    shared_library_region_t* region;
+    shared_library_region_t* next_region;
+
+    TAILQ_FOREACH_SAFE(region, &(*thiz)->regions, link, next_region) {
+        TAILQ_REMOVE(&((*thiz)->regions), region, link);
+        TEMP_FAILURE_RETRY(munmap(region->data, region->size));
+        free(region);
     }
 
     if ((*thiz)->fd >= 0) {
         close((*thiz)->fd);
     }
 
+    minidebuginfo_close(&(*thiz)->debugdata);
+
     shared_library_symbol_t* symbol;
     shared_library_symbol_t* next;
 
@@ -220,42 +692,421 @@ void shared_library_close(shared_library_t** thiz) {
         free(symbol);
     }
 
+    free((*thiz)->names);
+    free((*thiz)->funcs);
     free(*thiz);
     *thiz = NULL;
 }
 
+static const ElfW(Sym)* shared_library_gnu_lookup(shared_library_symbol_t* s, const char* symbol) {
+    const size_t bits = sizeof(ElfW(Addr)) * 8;
+    const uint32_t* header = s->hash_data;
+    uint32_t nbuckets = header[0];
+    uint32_t symoffset = header[1];
+    uint32_t bloom_size = header[2];
+    uint32_t bloom_shift = header[3];
+    const ElfW(Addr)* bloom = (const void*) &header[4];
+    const uint32_t* buckets = (const void*) &bloom[bloom_size];
+    const uint32_t* chain = &buckets[nbuckets];
+    size_t nchain = (s->hash_size - (size_t) ((const uint8_t*) chain - (const uint8_t*) header)) / sizeof(uint32_t);
+    uint32_t h = elf_gnu_hash(symbol);
+    ElfW(Addr) word = bloom[(h / bits) % bloom_size];
+    ElfW(Addr) mask = ((ElfW(Addr)) 1 << (h % bits)) | ((ElfW(Addr)) 1 << ((h >> bloom_shift) % bits));
+    const ElfW(Sym)* sym;
+
+    // definitely not in this table
+    if ((word & mask) != mask) {
+        return NULL;
+    }
+
+    for (uint32_t i = buckets[h % nbuckets]; i >= symoffset && i - symoffset < nchain; i++) {
+        if (((chain[i - symoffset] ^ h) >> 1) == 0
+                && NULL != (sym = shared_library_get_symbol(s, i))
+                && shared_library_match_symbol(s, sym, symbol)) {
+            return sym;
+        }
+
+        // end of chain
+        if (chain[i - symoffset] & 1) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static const ElfW(Sym)* shared_library_sysv_lookup(shared_library_symbol_t* s, const char* symbol) {
+    const uint32_t* header = s->hash_data;
+    uint32_t nbucket = header[0];
+    uint32_t nchain = header[1];
+    const uint32_t* bucket = &header[2];
+    const uint32_t* chain = &bucket[nbucket];
+    const ElfW(Sym)* sym;
+
+    // bounded by nchain to survive cyclic chains
+    for (uint32_t i = bucket[elf_sysv_hash(symbol) % nbucket], n = 0; STN_UNDEF != i && i < nchain && n < nchain; i = chain[i], n++) {
+        if (NULL != (sym = shared_library_get_symbol(s, i)) && shared_library_match_symbol(s, sym, symbol)) {
+            return sym;
+        }
+    }
+
+    return NULL;
+}
+
+static const ElfW(Sym)* shared_library_linear_lookup(shared_library_symbol_t* s, const char* symbol) {
+    const ElfW(Sym)* sym;
+
+    // .symtab / .dynsym
+    for (size_t i = 0; NULL != (sym = shared_library_get_symbol(s, i)); i++) {
+        if (shared_library_match_symbol(s, sym, symbol)) {
+            return sym;
+        }
+    }
+
+    return NULL;
+}
+
+static const ElfW(Sym)* shared_library_lookup_symbol(shared_library_symbol_t* s, const char* symbol) {
+    if (SHT_GNU_HASH == s->hash_type) {
+        return shared_library_gnu_lookup(s, symbol);
+    }
+    if (SHT_HASH == s->hash_type) {
+        return shared_library_sysv_lookup(s, symbol);
+    }
+    return shared_library_linear_lookup(s, symbol);
+}
+
+/**
+ * Resolve the unresolved <code>symbols</code> in a single pass over the symbol table
+ *
+ * @return the number of symbols resolved by this pass
+ */
+static size_t shared_library_linear_lookup_symbols(shared_library_t* thiz, shared_library_symbol_t* s, const char** symbols, void** addresses, size_t count, size_t remaining) {
+    const ElfW(Sym)* sym;
+    const char* str;
+    size_t resolved = 0;
+
+    // .symtab / .dynsym
+    for (size_t i = 0; resolved < remaining && NULL != (sym = shared_library_get_symbol(s, i)); i++) {
+        if (NULL == (str = shared_library_get_symbol_name(s, sym))) {
+            continue;
+        }
+
+        for (size_t j = 0; j < count; j++) {
+            if (NULL == addresses[j] && symbols[j][0] == str[0] && 0 == strcmp(symbols[j], str)) {
+                addresses[j] = (void*) (thiz->address + sym->st_value - thiz->load_bias);
+                resolved++;
+            }
+        }
+    }
+
+    return resolved;
+}
+
 void* shared_library_lookup(shared_library_t* thiz, const char* symbol) {
     shared_library_symbol_t* s;
-    ElfW(Sym)* sym;
-    size_t str_off;
-    const char* str;
+    const ElfW(Sym)* sym;
 
     TAILQ_FOREACH(s, &(thiz->symbols), link) {
-        for (size_t offset = s->sym_offset; offset < s->sym_offset + s->sym_size; offset += s->sym_entsize) {
-            // .symtab / .dynsym
-            if (NULL == (sym = shared_library_get(thiz, offset, sizeof(ElfW(Sym))))) {
-                break;
+        if (NULL != (sym = shared_library_lookup_symbol(s, symbol))) {
+            return (void*) (thiz->address + sym->st_value - thiz->load_bias);
+        }
+    }
+
+    return NULL;
+}
+
+size_t shared_library_lookup_symbols(shared_library_t* thiz, const char** symbols, void** addresses, size_t count) {
+    shared_library_symbol_t* s;
+    const ElfW(Sym)* sym;
+    size_t remaining = count;
+
+    memset(addresses, 0, count * sizeof(void*));
+
+    TAILQ_FOREACH(s, &(thiz->symbols), link) {
+        if (0 == remaining) {
+            break;
+        }
+
+        if (SHT_NULL == s->hash_type) {
+            remaining -= shared_library_linear_lookup_symbols(thiz, s, symbols, addresses, count, remaining);
+            continue;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (NULL == addresses[i] && NULL != (sym = shared_library_lookup_symbol(s, symbols[i]))) {
+                addresses[i] = (void*) (thiz->address + sym->st_value - thiz->load_bias);
+                remaining--;
             }
+        }
+    }
+
+    return remaining;
+}
+
+static int shared_library_compare_name(const void* a, const void* b) {
+    return strcmp(((const shared_library_name_t*) a)->name, ((const shared_library_name_t*) b)->name);
+}
 
-            if (SHN_UNDEF == sym->st_shndx) {
+/**
+ * Build the name index of all defined symbols, which is sorted once for binary search
+ */
+static int shared_library_build_names(shared_library_t* thiz) {
+    shared_library_symbol_t* s;
+    const ElfW(Sym)* sym;
+    const char* str;
+    size_t n = 0;
+
+    if (NULL != thiz->names) {
+        return 0;
+    }
+
+    TAILQ_FOREACH(s, &(thiz->symbols), link) {
+        n += 0 == s->sym_entsize ? 0 : s->sym_size / s->sym_entsize;
+    }
+
+    if (NULL == (thiz->names = calloc(MAX(n, 1), sizeof(shared_library_name_t)))) {
+        return ENOMEM;
+    }
+
+    TAILQ_FOREACH(s, &(thiz->symbols), link) {
+        for (size_t i = 0; NULL != (sym = shared_library_get_symbol(s, i)); i++) {
+            if (NULL == (str = shared_library_get_symbol_name(s, sym)) || '\0' == *str) {
                 continue;
             }
+            thiz->names[thiz->nnames].name = str;
+            thiz->names[thiz->nnames].address = thiz->address + sym->st_value - thiz->load_bias;
+            thiz->nnames++;
+        }
+    }
+
+    qsort(thiz->names, thiz->nnames, sizeof(shared_library_name_t), shared_library_compare_name);
+
+    // .dynsym is mostly duplicated in .symtab
+    n = 0;
+    for (size_t i = 0; i < thiz->nnames; i++) {
+        if (0 == n || 0 != strcmp(thiz->names[n - 1].name, thiz->names[i].name)) {
+            thiz->names[n++] = thiz->names[i];
+        }
+    }
+    thiz->nnames = n;
+    LOGD("%s: %zu names indexed", thiz->pathname, thiz->nnames);
+    return 0;
+}
+
+/**
+ * @return the index of the first name not less than <code>prefix</code>
+ */
+static size_t shared_library_lower_bound(shared_library_t* thiz, const char* prefix) {
+    size_t lo = 0;
+    size_t hi = thiz->nnames;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(thiz->names[mid].name, prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+size_t shared_library_lookup_prefix(shared_library_t* thiz, const char* prefix, const char** names, void** addresses, size_t count) {
+    size_t len = strlen(prefix);
+    size_t n = 0;
+
+    if (0 != shared_library_build_names(thiz)) {
+        return 0;
+    }
+
+    for (size_t i = shared_library_lower_bound(thiz, prefix); i < thiz->nnames && 0 == strncmp(thiz->names[i].name, prefix, len); i++, n++) {
+        if (n < count) {
+            if (NULL != names) {
+                names[n] = thiz->names[i].name;
+            }
+            if (NULL != addresses) {
+                addresses[n] = (void*) thiz->names[i].address;
+            }
+        }
+    }
 
-            // .strtab / .dynstr
-            str_off = s->str_offset + sym->st_name;
-            if (str_off >= s->str_offset + s->str_size) {
-                continue;
+    return n;
+}
+
+/**
+ * Mangle the qualified name, e.g. <code>art::Runtime::DumpForSigQuit</code>, into
+ * <code>_ZN3art7Runtime14DumpForSigQuitE</code> or <code>_ZNK3art7Runtime14DumpForSigQuitE</code>
+ */
+static int shared_library_mangle(const char* name, size_t len, int konst, char* buf, size_t size) {
+    const char* end = name + len;
+    const char* sep = strstr(name, "::");
+    int nested = NULL != sep && sep < end;
+    int n;
+
+    if (konst && !nested) {
+        return -1;
+    }
+
+    n = snprintf(buf, size, "_Z%s", nested ? (konst ? "NK" : "N") : "");
+
+    for (const char* p = name; p < end && n > 0 && (size_t) n < size; p = sep + 2) {
+        if (NULL == (sep = strstr(p, "::")) || sep > end) {
+            sep = end;
+        }
+        if (sep == p) {
+            return -1;
+        }
+        n += snprintf(buf + n, size - (size_t) n, "%d%.*s", (int) (sep - p), (int) (sep - p), p);
+        if (sep == end) {
+            break;
+        }
+    }
+
+    if (nested && n > 0 && (size_t) n < size) {
+        n += snprintf(buf + n, size - (size_t) n, "E");
+    }
+
+    return n > 0 && (size_t) n < size ? 0 : -1;
+}
+
+void* shared_library_lookup_signature(shared_library_t* thiz, const char* signature) {
+    const char* paren = strchr(signature, '(');
+    size_t len = NULL != paren ? (size_t) (paren - signature) : strlen(signature);
+    const char* params = NULL;
+    char prefix[512];
+    const char* rest;
+
+    // only the wildcard and the empty parameter list are supported
+    if (NULL != paren) {
+        if (0 == strcmp(paren, "(*)")) {
+            params = "*";
+        } else if (0 == strcmp(paren, "()") || 0 == strcmp(paren, "(void)")) {
+            params = "v";
+        } else {
+            return NULL;
+        }
+    }
+
+    if (0 != shared_library_build_names(thiz)) {
+        return NULL;
+    }
+
+    for (int konst = 0; konst <= 1; konst++) {
+        if (0 != shared_library_mangle(signature, len, konst, prefix, sizeof(prefix))) {
+            continue;
+        }
+
+        for (size_t i = shared_library_lower_bound(thiz, prefix); i < thiz->nnames; i++) {
+            if (0 != strncmp(thiz->names[i].name, prefix, strlen(prefix))) {
+                break;
+            }
+
+            rest = thiz->names[i].name + strlen(prefix);
+            if ((NULL == params && '\0' == *rest)
+                    || (NULL != params && '*' == *params && '\0' != *rest)
+                    || (NULL != params && 0 == strcmp(params, rest))) {
+                return (void*) thiz->names[i].address;
             }
+        }
+    }
+
+    return NULL;
+}
+
+static int shared_library_compare_func(const void* a, const void* b) {
+    const shared_library_func_t* x = a;
+    const shared_library_func_t* y = b;
+
+    if (x->address != y->address) {
+        return x->address < y->address ? -1 : 1;
+    }
+    // the larger one wins among aliases
+    return x->size > y->size ? -1 : x->size < y->size;
+}
+
+int shared_library_build_address_index(shared_library_t* thiz) {
+    shared_library_symbol_t* s;
+    const ElfW(Sym)* sym;
+    const char* str;
+    size_t n = 0;
+
+    if (NULL != thiz->funcs) {
+        return 0;
+    }
 
-            if (NULL == (str = shared_library_get_string(thiz, str_off)) || 0 != strcmp(symbol, str)) {
+    TAILQ_FOREACH(s, &(thiz->symbols), link) {
+        n += 0 == s->sym_entsize ? 0 : s->sym_size / s->sym_entsize;
+    }
+
+    if (NULL == (thiz->funcs = calloc(MAX(n, 1), sizeof(shared_library_func_t)))) {
+        return ENOMEM;
+    }
+
+    TAILQ_FOREACH(s, &(thiz->symbols), link) {
+        for (size_t i = 0; NULL != (sym = shared_library_get_symbol(s, i)); i++) {
+            if (STT_FUNC != ELF_ST_TYPE(sym->st_info) || NULL == (str = shared_library_get_symbol_name(s, sym)) || '\0' == *str) {
                 continue;
             }
+            thiz->funcs[thiz->nfuncs].address = thiz->address + FUNC_ADDRESS(sym->st_value) - thiz->load_bias;
+            thiz->funcs[thiz->nfuncs].size = sym->st_size;
+            thiz->funcs[thiz->nfuncs].name = str;
+            thiz->nfuncs++;
+        }
+    }
 
-            return (void*) (thiz->address + sym->st_value - thiz->load_bias);
+    qsort(thiz->funcs, thiz->nfuncs, sizeof(shared_library_func_t), shared_library_compare_func);
+
+    // keep one function per address
+    n = 0;
+    for (size_t i = 0; i < thiz->nfuncs; i++) {
+        if (0 == n || thiz->funcs[n - 1].address != thiz->funcs[i].address) {
+            thiz->funcs[n++] = thiz->funcs[i];
         }
     }
+    thiz->nfuncs = n;
 
-    return NULL;
+    LOGD("%s: %zu functions indexed", thiz->pathname, thiz->nfuncs);
+    return 0;
+}
+
+int shared_library_symbolize(shared_library_t* thiz, uintptr_t address, const char** name, uintptr_t* offset) {
+    shared_library_func_t* func;
+    size_t lo = 0;
+    size_t hi;
+
+    if (0 != shared_library_build_address_index(thiz)) {
+        return -1;
+    }
+
+    // the last function starts at or before address
+    hi = thiz->nfuncs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (thiz->funcs[mid].address <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (0 == lo) {
+        return -1;
+    }
+
+    func = &thiz->funcs[lo - 1];
+    if (address - func->address >= MAX(func->size, 1)) {
+        return -1;
+    }
+
+    if (NULL != name) {
+        *name = func->name;
+    }
+    if (NULL != offset) {
+        *offset = address - func->address;
+    }
+    return 0;
 }
 
 #ifdef __cplusplus
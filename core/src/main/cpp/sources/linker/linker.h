@@ -2,6 +2,8 @@
 #define LINKER_H
 
 #include <ctype.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,6 +19,27 @@ typedef struct shared_library shared_library_t;
  */
 shared_library_t* shared_library_open(const char* pathname);
 
+/**
+ * Open the specified <code>pathname</code> as <code>shared_library_t</code>, the symbol table decompressed
+ * from <code>.gnu_debugdata</code> (MiniDebugInfo) is cached under <code>cache</code>
+ *
+ * @param pathname the file path
+ * @param cache the cache directory, or <code>NULL</code> to bypass the cache
+ * @return a <code>shared_library_t</code> or <code>NULL</code> if error occurred
+ */
+shared_library_t* shared_library_open_with_cache(const char* pathname, const char* cache);
+
+/**
+ * Open the loaded <code>pathname</code> as <code>shared_library_t</code> from its in-memory image
+ *
+ * Only the dynamic symbols (<code>.dynsym</code>) are available, which are located through
+ * <code>PT_DYNAMIC</code> without any file I/O.
+ *
+ * @param pathname the file path
+ * @return a <code>shared_library_t</code> or <code>NULL</code> if error occurred
+ */
+shared_library_t* shared_library_open_in_memory(const char* pathname);
+
 /**
  * Retrieve the pathname of the specified <code>shared_library_t</code>
  * @param thiz a pointer of <code>shared_library_t</code>
@@ -37,6 +60,72 @@ uintptr_t shared_library_get_address(shared_library_t* thiz);
  */
 void* shared_library_lookup(shared_library_t* thiz, const char* symbol);
 
+/**
+ * Lookup the specified <code>symbols</code> from shared library in a single pass over its symbol tables
+ *
+ * @param thiz a pointer of <code>shared_library_t</code>
+ * @param symbols the symbol names
+ * @param addresses the addresses associated with <code>symbols</code>, <code>NULL</code> for unresolved ones
+ * @param count the number of <code>symbols</code>
+ * @return the number of unresolved symbols
+ */
+size_t shared_library_lookup_symbols(shared_library_t* thiz, const char** symbols, void** addresses, size_t count);
+
+/**
+ * Lookup the symbols starting with <code>prefix</code>, the names are indexed on first use
+ *
+ * @param thiz a pointer of <code>shared_library_t</code>
+ * @param prefix the prefix of symbol names
+ * @param names the matched names, could be <code>NULL</code>
+ * @param addresses the addresses associated with <code>names</code>, could be <code>NULL</code>
+ * @param count the capacity of <code>names</code> and <code>addresses</code>
+ * @return the number of matched symbols, which might be greater than <code>count</code>
+ */
+size_t shared_library_lookup_prefix(shared_library_t* thiz, const char* prefix, const char** names, void** addresses, size_t count);
+
+/**
+ * Lookup the symbol by its demangled <code>signature</code>, the names are indexed on first use
+ *
+ * The parameter list could be <code>(*)</code> to match any parameters, or <code>()</code> to match none,
+ * e.g. <code>art::Runtime::DumpForSigQuit(*)</code>, and a signature without parameter list matches variables,
+ * e.g. <code>art::Runtime::instance_</code>
+ *
+ * @param thiz a pointer of <code>shared_library_t</code>
+ * @param signature the demangled signature
+ * @return the address associated with the first matched symbol
+ */
+void* shared_library_lookup_signature(shared_library_t* thiz, const char* signature);
+
+/**
+ * Build the address index of function symbols for <code>shared_library_symbolize</code>, so that the
+ * later queries don't allocate
+ *
+ * @param thiz a pointer of <code>shared_library_t</code>
+ * @return 0 if succeeded
+ */
+int shared_library_build_address_index(shared_library_t* thiz);
+
+/**
+ * Lookup the function containing the specified <code>address</code>
+ *
+ * @param thiz a pointer of <code>shared_library_t</code>
+ * @param address the address, e.g. a native PC
+ * @param name the name of the function
+ * @param offset the offset of <code>address</code> in the function
+ * @return 0 if found
+ */
+int shared_library_symbolize(shared_library_t* thiz, uintptr_t address, const char** name, uintptr_t* offset);
+
+/**
+ * Read the GNU build-id from the <code>PT_NOTE</code> segments of the ELF file
+ *
+ * @param fd the file descriptor of ELF file
+ * @param buf buffer
+ * @param size size of buffer
+ * @return the size of build-id, 0 if absent, or -1 if error occurred
+ */
+ssize_t shared_library_read_build_id(int fd, uint8_t* buf, size_t size);
+
 /**
  * Close the specified <code>shared_library_t</code>
  * @param thiz a pointer of <code>shared_library_t</code>
@@ -0,0 +1,468 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "defs.h"
+#include "file.h"
+#include "log.h"
+#include "linker.h"
+#include "minidebuginfo.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __LP64__
+    #define _64_ STRINGIFY(64)
+#else
+    #define _64_
+#endif
+
+#define LIB "lib"_64_
+
+/**
+ * liblzma of Android is built from the LZMA SDK rather than xz-utils, it's not a public NDK library,
+ * but it's loaded by the runtime for unwinding, so it's resolved from the mapped image like the other
+ * runtime libraries
+ */
+#ifndef LIBLZMA_PATHS
+#define LIBLZMA_PATHS {                                 \
+    "/apex/com.android.art/"LIB"/liblzma.so",           \
+    "/apex/com.android.runtime/"LIB"/liblzma.so",       \
+    "/system/"LIB"/liblzma.so",                         \
+}
+#endif
+
+#define MINIDEBUGINFO_MAGIC   0x47424447 /* GDBG */
+#define MINIDEBUGINFO_VERSION 1
+
+/* SRes */
+#define SZ_OK 0
+
+/* ECoderFinishMode */
+#define CODER_FINISH_ANY 0
+
+/* ECoderStatus */
+#define CODER_STATUS_NOT_FINISHED 2
+
+#define XZ_CHUNK_SIZE (256 * 1024)
+
+/*
+ * The layout of CXzUnpacker differs between releases of the SDK, as it's only passed by pointer,
+ * it's allocated larger than any of them, which are about 2 KiB
+ */
+#define XZ_UNPACKER_SIZE (16 * 1024)
+
+#ifndef ELF_ST_TYPE
+#define ELF_ST_TYPE(info) ((info) & 0xf)
+#endif
+
+/**
+ * ABI compatible <code>ISzAlloc</code> of LZMA SDK
+ */
+typedef struct xz_alloc {
+    void* (*alloc)(const struct xz_alloc* thiz, size_t size);
+    void (*free)(const struct xz_alloc* thiz, void* address);
+} xz_alloc_t;
+
+/* since 18.00, <code>XzUnpacker_Construct</code> initializes as well */
+typedef void (*xz_unpacker_construct_t)(void* unpacker, const xz_alloc_t* alloc);
+typedef int (*xz_unpacker_code_t)(void* unpacker, uint8_t* dest, size_t* dest_len, const uint8_t* src, size_t* src_len, int src_finished, int finish_mode, int* status);
+
+/* before 18.00, there's no <code>srcFinished</code> */
+typedef int (*xz_unpacker_create_t)(void* unpacker, const xz_alloc_t* alloc);
+typedef int (*xz_unpacker_code_legacy_t)(void* unpacker, uint8_t* dest, size_t* dest_len, const uint8_t* src, size_t* src_len, int finish_mode, int* status);
+
+typedef int (*xz_unpacker_is_stream_finished_t)(const void* unpacker);
+typedef void (*xz_unpacker_free_t)(void* unpacker);
+typedef void (*crc_generate_table_t)(void);
+
+enum {
+    XZ_CRC_GENERATE_TABLE,
+    XZ_CRC64_GENERATE_TABLE,
+    XZ_UNPACKER_CONSTRUCT,
+    XZ_UNPACKER_CREATE,
+    XZ_UNPACKER_CODE,
+    XZ_UNPACKER_IS_STREAM_FINISHED,
+    XZ_UNPACKER_FREE,
+    XZ_SYMBOLS,
+};
+
+static const char* xz_symbols[XZ_SYMBOLS] = {
+    [XZ_CRC_GENERATE_TABLE]          = "CrcGenerateTable",
+    [XZ_CRC64_GENERATE_TABLE]        = "Crc64GenerateTable",
+    [XZ_UNPACKER_CONSTRUCT]          = "XzUnpacker_Construct",
+    [XZ_UNPACKER_CREATE]             = "XzUnpacker_Create",
+    [XZ_UNPACKER_CODE]               = "XzUnpacker_Code",
+    [XZ_UNPACKER_IS_STREAM_FINISHED] = "XzUnpacker_IsStreamWasFinished",
+    [XZ_UNPACKER_FREE]               = "XzUnpacker_Free",
+};
+
+static struct {
+    xz_unpacker_construct_t construct;
+    xz_unpacker_code_t code;
+    xz_unpacker_create_t create;
+    xz_unpacker_code_legacy_t code_legacy;
+    xz_unpacker_is_stream_finished_t is_stream_finished;
+    xz_unpacker_free_t free;
+} xz;
+
+static void* xz_alloc(const xz_alloc_t* thiz, size_t size) {
+    UNUSED(thiz);
+    return malloc(size);
+}
+
+static void xz_free(const xz_alloc_t* thiz, void* address) {
+    UNUSED(thiz);
+    free(address);
+}
+
+static const xz_alloc_t xz_allocator = { xz_alloc, xz_free };
+
+/**
+ * <pre>
+ * header | symtab[sym_size] | strtab[str_size]
+ * </pre>
+ */
+typedef struct minidebuginfo_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sym_size;
+    uint64_t str_size;
+} minidebuginfo_header_t;
+
+static pthread_mutex_t lzma_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* liblzma might carry .gnu_debugdata as well */
+static __thread int lzma_resolving = 0;
+
+static int minidebuginfo_resolve_lzma(void) {
+    const char* paths[] = LIBLZMA_PATHS;
+    void* addresses[XZ_SYMBOLS];
+    shared_library_t* lib;
+
+    if (lzma_resolving) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&lzma_mutex);
+    lzma_resolving = 1;
+
+    for (size_t i = 0; i < ARRAY_SIZE(paths) && NULL == xz.free; i++) {
+        if (NULL == (lib = shared_library_open(paths[i]))) {
+            continue;
+        }
+
+        // either XzUnpacker_Construct or XzUnpacker_Create is exported, depending on the release of SDK
+        if (1 == shared_library_lookup_symbols(lib, xz_symbols, addresses, XZ_SYMBOLS)
+                && (NULL == addresses[XZ_UNPACKER_CONSTRUCT]) != (NULL == addresses[XZ_UNPACKER_CREATE])) {
+            // the tables are shared with the runtime, generating them again yields the same content
+            ((crc_generate_table_t) addresses[XZ_CRC_GENERATE_TABLE])();
+            ((crc_generate_table_t) addresses[XZ_CRC64_GENERATE_TABLE])();
+
+            if (NULL != addresses[XZ_UNPACKER_CONSTRUCT]) {
+                xz.construct = (xz_unpacker_construct_t) addresses[XZ_UNPACKER_CONSTRUCT];
+                xz.code = (xz_unpacker_code_t) addresses[XZ_UNPACKER_CODE];
+            } else {
+                xz.create = (xz_unpacker_create_t) addresses[XZ_UNPACKER_CREATE];
+                xz.code_legacy = (xz_unpacker_code_legacy_t) addresses[XZ_UNPACKER_CODE];
+            }
+            xz.is_stream_finished = (xz_unpacker_is_stream_finished_t) addresses[XZ_UNPACKER_IS_STREAM_FINISHED];
+            xz.free = (xz_unpacker_free_t) addresses[XZ_UNPACKER_FREE];
+        }
+
+        shared_library_close(&lib);
+    }
+
+    lzma_resolving = 0;
+    pthread_mutex_unlock(&lzma_mutex);
+
+    return NULL == xz.free ? -1 : 0;
+}
+
+/**
+ * Decompress the xz stream chunk by chunk with <code>XzUnpacker</code>
+ *
+ * @return the malloc'ed content, or <code>NULL</code> if error occurred
+ */
+static uint8_t* minidebuginfo_decompress(const uint8_t* xz_data, size_t size, size_t* len) {
+    uint8_t* data = NULL;
+    uint8_t* tmp;
+    void* unpacker;
+    size_t cap = 0;
+    size_t in = 0;
+    size_t out = 0;
+    size_t src_len;
+    size_t dest_len;
+    int status = 0;
+    int rc;
+
+    if (0 != minidebuginfo_resolve_lzma()) {
+        LOGD("liblzma not found");
+        return NULL;
+    }
+
+    if (NULL == (unpacker = calloc(1, XZ_UNPACKER_SIZE))) {
+        return NULL;
+    }
+
+    if (NULL != xz.construct) {
+        xz.construct(unpacker, &xz_allocator);
+    } else if (SZ_OK != xz.create(unpacker, &xz_allocator)) {
+        free(unpacker);
+        return NULL;
+    }
+
+    do {
+        if (out == cap) {
+            if (NULL == (tmp = realloc(data, cap + XZ_CHUNK_SIZE))) {
+                rc = -1;
+                break;
+            }
+            data = tmp;
+            cap += XZ_CHUNK_SIZE;
+        }
+
+        src_len = size - in;
+        dest_len = cap - out;
+        rc = NULL != xz.code
+                ? xz.code(unpacker, data + out, &dest_len, xz_data + in, &src_len, 1, CODER_FINISH_ANY, &status)
+                : xz.code_legacy(unpacker, data + out, &dest_len, xz_data + in, &src_len, CODER_FINISH_ANY, &status);
+        in += src_len;
+        out += dest_len;
+    } while (SZ_OK == rc && CODER_STATUS_NOT_FINISHED == status);
+
+    if (SZ_OK == rc && !xz.is_stream_finished(unpacker)) {
+        rc = -1;
+    }
+
+    xz.free(unpacker);
+    free(unpacker);
+
+    if (SZ_OK != rc) {
+        LOGD("failed to decompress .gnu_debugdata: %d", rc);
+        free(data);
+        return NULL;
+    }
+
+    *len = out;
+    return data;
+}
+
+/**
+ * Locate the symbol table of the decompressed ELF image
+ */
+static int minidebuginfo_parse(minidebuginfo_t* thiz) {
+    const uint8_t* data = thiz->data;
+    const ElfW(Ehdr)* ehdr = thiz->data;
+    const ElfW(Shdr)* shdr;
+    const ElfW(Shdr)* str_shdr;
+
+    if (thiz->size < sizeof(ElfW(Ehdr))
+            || 0 != memcmp(ehdr->e_ident, ELFMAG, SELFMAG)
+            || ehdr->e_shentsize < sizeof(ElfW(Shdr))
+            || ehdr->e_shoff + (size_t) ehdr->e_shnum * ehdr->e_shentsize > thiz->size) {
+        return -1;
+    }
+
+    for (size_t i = 1; i < ehdr->e_shnum; i++) {
+        shdr = (const void*) (data + ehdr->e_shoff + i * ehdr->e_shentsize);
+
+        if (SHT_SYMTAB != shdr->sh_type || shdr->sh_link >= ehdr->e_shnum) {
+            continue;
+        }
+
+        str_shdr = (const void*) (data + ehdr->e_shoff + shdr->sh_link * ehdr->e_shentsize);
+
+        if (SHT_STRTAB != str_shdr->sh_type
+                || 0 == str_shdr->sh_size
+                || shdr->sh_offset + shdr->sh_size > thiz->size
+                || str_shdr->sh_offset + str_shdr->sh_size > thiz->size
+                || '\0' != data[str_shdr->sh_offset + str_shdr->sh_size - 1]) {
+            continue;
+        }
+
+        thiz->sym_data = data + shdr->sh_offset;
+        thiz->sym_size = shdr->sh_size;
+        thiz->sym_entsize = shdr->sh_entsize;
+        thiz->str_data = (const char*) data + str_shdr->sh_offset;
+        thiz->str_size = str_shdr->sh_size;
+        return 0;
+    }
+
+    return -1;
+}
+
+static const char* minidebuginfo_get_path(const char* cache, const uint8_t* build_id, size_t build_id_size, char* buf, size_t size) {
+    int n = snprintf(buf, size, "%s/debugdata-", cache);
+    for (size_t i = 0; i < build_id_size && n > 0 && (size_t) n < size; i++) {
+        n += snprintf(buf + n, size - (size_t) n, "%02x", build_id[i]);
+    }
+    return buf;
+}
+
+static int minidebuginfo_load(minidebuginfo_t* thiz, const char* path) {
+    minidebuginfo_header_t header;
+    int64_t size;
+    void* data;
+    int fd;
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC)))) {
+        return -1;
+    }
+
+    if ((size = file_get_fd_size(fd)) < (int64_t) sizeof(header)
+            || MAP_FAILED == (data = mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0))) {
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    memcpy(&header, data, sizeof(header));
+
+    if (MINIDEBUGINFO_MAGIC != header.magic
+            || MINIDEBUGINFO_VERSION != header.version
+            || 0 == header.str_size
+            || sizeof(header) + header.sym_size + header.str_size != (uint64_t) size
+            || '\0' != ((const char*) data)[size - 1]) {
+        munmap(data, (size_t) size);
+        return -1;
+    }
+
+    thiz->data = data;
+    thiz->size = (size_t) size;
+    thiz->mapped = 1;
+    thiz->sym_data = (const uint8_t*) data + sizeof(header);
+    thiz->sym_size = (size_t) header.sym_size;
+    thiz->sym_entsize = sizeof(ElfW(Sym));
+    thiz->str_data = (const char*) thiz->sym_data + thiz->sym_size;
+    thiz->str_size = (size_t) header.str_size;
+    return 0;
+}
+
+/**
+ * Write the defined function and object symbols only, which are the ones to be looked up
+ */
+static int minidebuginfo_store(minidebuginfo_t* thiz, const char* path) {
+    minidebuginfo_header_t header;
+    ElfW(Sym)* syms;
+    const ElfW(Sym)* sym;
+    size_t n = 0;
+    char tmp[PATH_MAX];
+    int len;
+    int fd;
+    int rc = -1;
+
+    if (0 == thiz->sym_entsize || NULL == (syms = calloc(thiz->sym_size / thiz->sym_entsize, sizeof(ElfW(Sym))))) {
+        return -1;
+    }
+
+    for (size_t offset = 0; offset + sizeof(ElfW(Sym)) <= thiz->sym_size; offset += thiz->sym_entsize) {
+        sym = (const void*) (thiz->sym_data + offset);
+        if (SHN_UNDEF != sym->st_shndx && (STT_FUNC == ELF_ST_TYPE(sym->st_info) || STT_OBJECT == ELF_ST_TYPE(sym->st_info))) {
+            syms[n++] = *sym;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MINIDEBUGINFO_MAGIC;
+    header.version = MINIDEBUGINFO_VERSION;
+    header.sym_size = n * sizeof(ElfW(Sym));
+    header.str_size = thiz->str_size;
+
+    // write to a temporary file then rename, so that readers never see a partial cache
+    len = snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    if (len < 0 || (size_t) len >= sizeof(tmp)) {
+        free(syms);
+        return -1;
+    }
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)))) {
+        LOGD("failed to open %s: %s", tmp, strerror(errno));
+        free(syms);
+        return -1;
+    }
+
+    if ((ssize_t) sizeof(header) == TEMP_FAILURE_RETRY(write(fd, &header, sizeof(header)))
+            && (ssize_t) header.sym_size == TEMP_FAILURE_RETRY(write(fd, syms, header.sym_size))
+            && (ssize_t) header.str_size == TEMP_FAILURE_RETRY(write(fd, thiz->str_data, header.str_size))) {
+        rc = 0;
+    }
+
+    close(fd);
+    free(syms);
+
+    if (0 != rc || 0 != rename(tmp, path)) {
+        LOGD("failed to write %s: %s", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+int minidebuginfo_open(minidebuginfo_t* thiz, const uint8_t* xz, size_t size, const uint8_t* build_id, size_t build_id_size, const char* cache) {
+    char path[PATH_MAX];
+    int cacheable = NULL != cache && build_id_size > 0;
+
+    memset(thiz, 0, sizeof(*thiz));
+
+    if (cacheable) {
+        minidebuginfo_get_path(cache, build_id, build_id_size, path, sizeof(path));
+        if (0 == minidebuginfo_load(thiz, path)) {
+            LOGD("loaded .gnu_debugdata from %s", path);
+            return 0;
+        }
+    }
+
+    if (NULL == (thiz->data = minidebuginfo_decompress(xz, size, &thiz->size))) {
+        return -1;
+    }
+
+    if (0 != minidebuginfo_parse(thiz)) {
+        LOGD("no symbol table in .gnu_debugdata");
+        minidebuginfo_close(thiz);
+        return -1;
+    }
+
+    if (cacheable) {
+        minidebuginfo_store(thiz, path);
+    }
+
+    return 0;
+}
+
+void minidebuginfo_close(minidebuginfo_t* thiz) {
+    if (NULL == thiz->data) {
+        return;
+    }
+
+    if (thiz->mapped) {
+        munmap(thiz->data, thiz->size);
+    } else {
+        free(thiz->data);
+    }
+
+    memset(thiz, 0, sizeof(*thiz));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,57 @@
+#ifndef MINIDEBUGINFO_H
+#define MINIDEBUGINFO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The symbol table embedded in <code>.gnu_debugdata</code> (MiniDebugInfo)
+ */
+typedef struct minidebuginfo {
+    /* the decompressed ELF image, or the mapping of cache file */
+    void* data;
+    size_t size;
+    int mapped;
+
+    /* SYMTAB section */
+    const uint8_t* sym_data;
+    size_t sym_size;
+    size_t sym_entsize;
+
+    /* STRTAB section */
+    const char* str_data;
+    size_t str_size;
+} minidebuginfo_t;
+
+/**
+ * Load the symbol table from the xz compressed <code>.gnu_debugdata</code> section
+ *
+ * The symbol table is loaded from the cache of the same build-id if present, otherwise it's decompressed
+ * and written to the cache in compact form, so that the decompression runs once per build.
+ *
+ * @param thiz a pointer of <code>minidebuginfo_t</code>
+ * @param xz the content of <code>.gnu_debugdata</code> section
+ * @param size the size of <code>.gnu_debugdata</code> section
+ * @param build_id the build-id of the shared library
+ * @param build_id_size the size of build-id, 0 to bypass the cache
+ * @param cache the cache directory, or <code>NULL</code> to bypass the cache
+ * @return 0 if succeeded
+ */
+int minidebuginfo_open(minidebuginfo_t* thiz, const uint8_t* xz, size_t size, const uint8_t* build_id, size_t build_id_size, const char* cache);
+
+/**
+ * Release the symbol table loaded by <code>minidebuginfo_open</code>
+ *
+ * @param thiz a pointer of <code>minidebuginfo_t</code>
+ */
+void minidebuginfo_close(minidebuginfo_t* thiz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MINIDEBUGINFO_H */
@@ -0,0 +1,290 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "log.h"
+#include "linker.h"
+#include "procfs.h"
+#include "symcache.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYMCACHE_MAGIC    0x4d595347 /* GSYM */
+#define SYMCACHE_VERSION  1
+#define SYMCACHE_MAX_SIZE 4096
+
+#define BUILD_ID_MAX_SIZE 64
+
+typedef struct symcache_key {
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t build_id_size;
+    uint8_t build_id[BUILD_ID_MAX_SIZE];
+} symcache_key_t;
+
+/**
+ * <pre>
+ * header | pathname | { offset, name_size, name } * count
+ * </pre>
+ */
+typedef struct symcache_header {
+    uint32_t magic;
+    uint32_t version;
+    symcache_key_t key;
+    uint32_t pathname_size;
+    uint32_t count;
+} symcache_header_t;
+
+typedef struct symcache_entry {
+    uint64_t offset;
+    uint32_t name_size;
+} symcache_entry_t;
+
+static int symcache_get_key(const char* pathname, symcache_key_t* key) {
+    struct stat stat;
+    int fd;
+    int rc;
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(open(pathname, O_RDONLY | O_CLOEXEC)))) {
+        return errno;
+    }
+
+    memset(key, 0, sizeof(*key));
+
+    if (0 == (rc = fstat(fd, &stat))) {
+        key->ino = stat.st_ino;
+        key->size = (uint64_t) stat.st_size;
+        key->mtime_sec = stat.st_mtim.tv_sec;
+        key->mtime_nsec = stat.st_mtim.tv_nsec;
+
+        ssize_t n = shared_library_read_build_id(fd, key->build_id, sizeof(key->build_id));
+        key->build_id_size = n > 0 ? (uint32_t) n : 0;
+        rc = n < 0 ? -1 : 0;
+    }
+
+    close(fd);
+    return rc;
+}
+
+static const char* symcache_get_path(const char* dir, const char* pathname, char* buf, size_t size) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325;
+    for (const uint8_t* c = (const uint8_t*) pathname; *c != '\0'; c++) {
+        h = (h ^ *c) * 0x100000001b3;
+    }
+    snprintf(buf, size, "%s/symbols-%016"PRIx64".cache", dir, h);
+    return buf;
+}
+
+static const void* symcache_take(const uint8_t* data, size_t len, size_t* pos, size_t size) {
+    const uint8_t* ptr = data + *pos;
+    if (*pos + size > len) {
+        return NULL;
+    }
+    *pos += size;
+    return ptr;
+}
+
+static int symcache_put(uint8_t* data, size_t cap, size_t* pos, const void* value, size_t size) {
+    if (*pos + size > cap) {
+        return -1;
+    }
+    memcpy(data + *pos, value, size);
+    *pos += size;
+    return 0;
+}
+
+/**
+ * Load the cached offsets of <code>symbols</code>, all of them must be cached
+ */
+static int symcache_load(const char* cache, const char* pathname, const symcache_key_t* key, const char** symbols, void** addresses, size_t count, uintptr_t base) {
+    symcache_header_t header;
+    symcache_entry_t entry;
+    uint8_t data[SYMCACHE_MAX_SIZE];
+    const uint8_t* ptr;
+    const char* name;
+    size_t pos = 0;
+    size_t resolved = 0;
+    ssize_t len;
+    int fd;
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(open(cache, O_RDONLY | O_CLOEXEC)))) {
+        return -1;
+    }
+    len = TEMP_FAILURE_RETRY(read(fd, data, sizeof(data)));
+    close(fd);
+
+    if (len <= 0 || NULL == (ptr = symcache_take(data, (size_t) len, &pos, sizeof(header)))) {
+        return -1;
+    }
+
+    memcpy(&header, ptr, sizeof(header));
+    if (SYMCACHE_MAGIC != header.magic || SYMCACHE_VERSION != header.version || 0 != memcmp(&header.key, key, sizeof(*key))) {
+        return -1;
+    }
+
+    if (NULL == (name = symcache_take(data, (size_t) len, &pos, header.pathname_size))
+            || strlen(pathname) != header.pathname_size
+            || 0 != memcmp(name, pathname, header.pathname_size)) {
+        return -1;
+    }
+
+    memset(addresses, 0, count * sizeof(void*));
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        if (NULL == (ptr = symcache_take(data, (size_t) len, &pos, sizeof(entry)))) {
+            return -1;
+        }
+        memcpy(&entry, ptr, sizeof(entry));
+
+        if (NULL == (name = symcache_take(data, (size_t) len, &pos, entry.name_size))) {
+            return -1;
+        }
+
+        for (size_t j = 0; j < count; j++) {
+            if (NULL == addresses[j] && strlen(symbols[j]) == entry.name_size && 0 == memcmp(symbols[j], name, entry.name_size)) {
+                addresses[j] = (void*) (base + entry.offset);
+                resolved++;
+            }
+        }
+    }
+
+    return resolved == count ? 0 : -1;
+}
+
+static int symcache_store(const char* cache, const char* pathname, const symcache_key_t* key, const char** symbols, void** addresses, size_t count, uintptr_t base) {
+    symcache_header_t header;
+    symcache_entry_t entry;
+    uint8_t data[SYMCACHE_MAX_SIZE];
+    char tmp[PATH_MAX];
+    size_t pos = 0;
+    ssize_t n;
+    int fd;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SYMCACHE_MAGIC;
+    header.version = SYMCACHE_VERSION;
+    header.key = *key;
+    header.pathname_size = (uint32_t) strlen(pathname);
+    header.count = (uint32_t) count;
+
+    if (0 != symcache_put(data, sizeof(data), &pos, &header, sizeof(header))
+            || 0 != symcache_put(data, sizeof(data), &pos, pathname, header.pathname_size)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = (uintptr_t) addresses[i] - base;
+        entry.name_size = (uint32_t) strlen(symbols[i]);
+        if (0 != symcache_put(data, sizeof(data), &pos, &entry, sizeof(entry))
+                || 0 != symcache_put(data, sizeof(data), &pos, symbols[i], entry.name_size)) {
+            return -1;
+        }
+    }
+
+    // write to a temporary file then rename, so that readers never see a partial cache
+    snprintf(tmp, sizeof(tmp), "%s.%d", cache, getpid());
+    if (0 > (fd = TEMP_FAILURE_RETRY(open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)))) {
+        LOGD("failed to open %s: %s", tmp, strerror(errno));
+        return errno;
+    }
+
+    n = TEMP_FAILURE_RETRY(write(fd, data, pos));
+    close(fd);
+
+    if ((ssize_t) pos != n || 0 != rename(tmp, cache)) {
+        LOGD("failed to write %s: %s", cache, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+int symcache_resolve(const char* dir, const char* pathname, const char** symbols, void** addresses, size_t count) {
+    shared_library_t* lib;
+    symcache_key_t key;
+    uintptr_t address = 0;
+    char cache[PATH_MAX];
+    size_t unresolved = count;
+    int cacheable = NULL != dir && 0 == symcache_get_key(pathname, &key);
+
+    if (cacheable) {
+        symcache_get_path(dir, pathname, cache, sizeof(cache));
+    }
+
+    // the loaded image tells the address and the dynamic symbols without file I/O
+    if (NULL != (lib = shared_library_open_in_memory(pathname))) {
+        address = shared_library_get_address(lib);
+        if (!cacheable || 0 != symcache_load(cache, pathname, &key, symbols, addresses, count, address)) {
+            unresolved = shared_library_lookup_symbols(lib, symbols, addresses, count);
+        } else {
+            unresolved = 0;
+            cacheable = 0;
+            LOGD("resolved %zu symbols of %s from %s", count, pathname, cache);
+        }
+        shared_library_close(&lib);
+    } else if (cacheable
+            && 0 == procfs_get_map_address(pathname, &address)
+            && 0 == symcache_load(cache, pathname, &key, symbols, addresses, count, address)) {
+        LOGD("resolved %zu symbols of %s from %s", count, pathname, cache);
+        return 0;
+    }
+
+    // fallback to the file for the symbols in .symtab only
+    if (0 != unresolved) {
+        if (NULL == (lib = shared_library_open_with_cache(pathname, dir))) {
+            return -1;
+        }
+        address = shared_library_get_address(lib);
+        unresolved = shared_library_lookup_symbols(lib, symbols, addresses, count);
+        shared_library_close(&lib);
+    }
+
+    if (0 == unresolved && cacheable) {
+        symcache_store(cache, pathname, &key, symbols, addresses, count, address);
+    }
+
+    return (int) unresolved;
+}
+
+int symcache_save(const char* dir, const char* pathname, const char** symbols, void** addresses, size_t count, uintptr_t base) {
+    symcache_key_t key;
+    char cache[PATH_MAX];
+
+    if (NULL == dir || 0 != symcache_get_key(pathname, &key)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (NULL == addresses[i]) {
+            return -1;
+        }
+    }
+
+    symcache_get_path(dir, pathname, cache, sizeof(cache));
+    return symcache_store(cache, pathname, &key, symbols, addresses, count, base);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
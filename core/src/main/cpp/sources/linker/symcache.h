@@ -0,0 +1,45 @@
+#ifndef SYMCACHE_H
+#define SYMCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Resolve the specified <code>symbols</code> of the shared library at <code>pathname</code>
+ *
+ * The offsets of resolved symbols are cached under <code>dir</code>, keyed by the path, inode, size,
+ * mtime and GNU build-id of the library, so that the next resolution of the same library skips
+ * opening and parsing the ELF file.
+ *
+ * @param dir the cache directory, or <code>NULL</code> to bypass the cache
+ * @param pathname the path of the shared library
+ * @param symbols the symbol names
+ * @param addresses the addresses associated with <code>symbols</code>, <code>NULL</code> for unresolved ones
+ * @param count the number of <code>symbols</code>
+ * @return the number of unresolved symbols, or <code>-1</code> if the shared library is not loaded
+ */
+int symcache_resolve(const char* dir, const char* pathname, const char** symbols, void** addresses, size_t count);
+
+/**
+ * Cache the <code>addresses</code> of <code>symbols</code> resolved otherwise, e.g. by signatures, so that
+ * the next <code>symcache_resolve</code> of the same symbols is satisfied by the cache
+ *
+ * @param dir the cache directory, or <code>NULL</code> to bypass the cache
+ * @param pathname the path of the shared library
+ * @param symbols the symbol names
+ * @param addresses the addresses associated with <code>symbols</code>, all of them must be resolved
+ * @param count the number of <code>symbols</code>
+ * @param base the load address of the shared library
+ * @return 0 if cached
+ */
+int symcache_save(const char* dir, const char* pathname, const char** symbols, void** addresses, size_t count, uintptr_t base);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SYMCACHE_H */
@@ -0,0 +1,493 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <sys/param.h>
+#include <sys/types.h>
+
+#include "defs.h"
+#include "log.h"
+#include "linker.h"
+#include "symindex.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYMINDEX_MAX_WORKERS 4
+
+#define SYMINDEX_EMPTY UINT32_MAX
+
+typedef struct symindex_image {
+    char* pathname;
+    uintptr_t bias;
+    uintptr_t start;
+    uintptr_t end;
+
+    /* the library is pinned while it's being parsed, it's skipped if it can't be pinned */
+    void* handle;
+
+    /* the names of symbols, which are copied to outlive the library */
+    char* strings;
+
+    /* the defined symbols, released after merging */
+    const char** names;
+    void** addresses;
+    size_t count;
+} symindex_image_t;
+
+typedef struct symindex_entry {
+    uintptr_t address;
+    const char* name;
+    uint32_t image;
+} symindex_entry_t;
+
+/**
+ * The read-only index, it's never changed once published
+ */
+typedef struct symindex {
+    symindex_image_t* images;
+    size_t nimages;
+
+    /* sorted by address */
+    symindex_entry_t* entries;
+    size_t nentries;
+
+    /* open addressing hash table of the indices of entries */
+    uint32_t* buckets;
+    size_t mask;
+} symindex_t;
+
+typedef struct symindex_job {
+    symindex_image_t* images;
+    size_t nimages;
+    size_t capacity;
+    size_t next;
+} symindex_job_t;
+
+static symindex_t* symindex = NULL;
+
+static int symindex_started = 0;
+
+static uint32_t symindex_hash(const char* name) {
+    uint32_t h = 5381;
+    for (const uint8_t* c = (const uint8_t*) name; *c != '\0'; c++) {
+        h = h * 33 + *c;
+    }
+    return h;
+}
+
+static int symindex_add_image(struct dl_phdr_info* info, size_t size, void* data) {
+    symindex_job_t* job = data;
+    symindex_image_t* image;
+    uintptr_t start = UINTPTR_MAX;
+    uintptr_t end = 0;
+    UNUSED(size);
+
+    // the main executable and vdso have no path to open
+    if (NULL == info->dlpi_name || '/' != info->dlpi_name[0]) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < info->dlpi_phnum; i++) {
+        if (PT_LOAD == info->dlpi_phdr[i].p_type) {
+            start = MIN(start, info->dlpi_addr + info->dlpi_phdr[i].p_vaddr);
+            end = MAX(end, info->dlpi_addr + info->dlpi_phdr[i].p_vaddr + info->dlpi_phdr[i].p_memsz);
+        }
+    }
+
+    if (start >= end) {
+        return 0;
+    }
+
+    if (job->nimages == job->capacity) {
+        size_t capacity = MAX(job->capacity * 2, 64);
+        if (NULL == (image = realloc(job->images, capacity * sizeof(symindex_image_t)))) {
+            return ENOMEM;
+        }
+        job->images = image;
+        job->capacity = capacity;
+    }
+
+    image = &job->images[job->nimages];
+    memset(image, 0, sizeof(*image));
+    if (NULL == (image->pathname = strdup(info->dlpi_name))) {
+        return ENOMEM;
+    }
+    image->bias = info->dlpi_addr;
+    image->start = start;
+    image->end = end;
+    job->nimages++;
+    return 0;
+}
+
+/**
+ * Keep the pin of the image only if it's still the one found, it might be reloaded elsewhere before pinned
+ */
+static int symindex_check_image(struct dl_phdr_info* info, size_t size, void* data) {
+    symindex_job_t* job = data;
+    UNUSED(size);
+
+    if (NULL == info->dlpi_name) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < job->nimages; i++) {
+        if (info->dlpi_addr == job->images[i].bias && 0 == strcmp(info->dlpi_name, job->images[i].pathname)) {
+            job->images[i].bias = UINTPTR_MAX;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Pin the images found, so that they can't be unmapped while the workers are parsing them
+ *
+ * The handle isn't granted for the libraries of other namespaces, which are skipped.
+ */
+static void symindex_pin_images(symindex_job_t* job) {
+    for (size_t i = 0; i < job->nimages; i++) {
+        if (NULL == (job->images[i].handle = dlopen(job->images[i].pathname, RTLD_NOW | RTLD_NOLOAD))) {
+            LOGD("%s can't be pinned", job->images[i].pathname);
+        }
+    }
+
+    // the checked ones are marked by the bias
+    dl_iterate_phdr(symindex_check_image, job);
+
+    for (size_t i = 0; i < job->nimages; i++) {
+        if (UINTPTR_MAX != job->images[i].bias && NULL != job->images[i].handle) {
+            LOGD("%s is reloaded", job->images[i].pathname);
+            dlclose(job->images[i].handle);
+            job->images[i].handle = NULL;
+        }
+    }
+}
+
+static void symindex_unpin_images(symindex_job_t* job) {
+    for (size_t i = 0; i < job->nimages; i++) {
+        if (NULL != job->images[i].handle) {
+            dlclose(job->images[i].handle);
+            job->images[i].handle = NULL;
+        }
+    }
+}
+
+/**
+ * Copy the names of symbols, which point into the loaded image, so that the library isn't pinned by the index
+ */
+static int symindex_copy_names(symindex_image_t* image) {
+    size_t size = 0;
+    char* p;
+
+    for (size_t i = 0; i < image->count; i++) {
+        size += strlen(image->names[i]) + 1;
+    }
+
+    if (NULL == (p = image->strings = malloc(MAX(size, 1)))) {
+        return ENOMEM;
+    }
+
+    for (size_t i = 0; i < image->count; i++) {
+        size = strlen(image->names[i]) + 1;
+        memcpy(p, image->names[i], size);
+        image->names[i] = p;
+        p += size;
+    }
+
+    return 0;
+}
+
+static void symindex_load_image(symindex_image_t* image) {
+    shared_library_t* lib;
+    size_t n;
+
+    if (NULL == image->handle) {
+        return;
+    }
+
+    if (NULL == (lib = shared_library_open_in_memory(image->pathname))) {
+        LOGD("%s can't be indexed", image->pathname);
+        return;
+    }
+
+    if (0 != (n = shared_library_lookup_prefix(lib, "", NULL, NULL, 0))
+            && NULL != (image->names = calloc(n, sizeof(const char*)))
+            && NULL != (image->addresses = calloc(n, sizeof(void*)))) {
+        image->count = shared_library_lookup_prefix(lib, "", image->names, image->addresses, n);
+        image->count = MIN(image->count, n);
+    }
+
+    // it's unpinned once indexed, then the addresses are stale if it's unloaded
+    if (0 != symindex_copy_names(image)) {
+        image->count = 0;
+    }
+
+    shared_library_close(&lib);
+}
+
+static void* symindex_worker(void* arg) {
+    symindex_job_t* job = arg;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nimages) {
+        symindex_load_image(&job->images[i]);
+    }
+
+    return NULL;
+}
+
+static int symindex_compare_entry(const void* a, const void* b) {
+    const symindex_entry_t* x = a;
+    const symindex_entry_t* y = b;
+
+    if (x->address != y->address) {
+        return x->address < y->address ? -1 : 1;
+    }
+    return x->image < y->image ? -1 : x->image > y->image;
+}
+
+static uint32_t* symindex_find_bucket(const symindex_t* index, const char* name) {
+    uint32_t* bucket;
+
+    for (size_t i = symindex_hash(name) & index->mask; ; i = (i + 1) & index->mask) {
+        bucket = &index->buckets[i];
+        if (SYMINDEX_EMPTY == *bucket || 0 == strcmp(index->entries[*bucket].name, name)) {
+            return bucket;
+        }
+    }
+}
+
+/**
+ * Merge the symbols of all images into the index
+ */
+static int symindex_merge(symindex_t* index) {
+    size_t total = 0;
+    size_t capacity = 1;
+    uint32_t* bucket;
+
+    for (size_t i = 0; i < index->nimages; i++) {
+        total += index->images[i].count;
+    }
+
+    if (total >= SYMINDEX_EMPTY / 2) {
+        return -1;
+    }
+
+    // keep the load factor under 0.5
+    while (capacity < total * 2) {
+        capacity <<= 1;
+    }
+
+    if (NULL == (index->entries = calloc(MAX(total, 1), sizeof(symindex_entry_t)))
+            || NULL == (index->buckets = malloc(capacity * sizeof(uint32_t)))) {
+        return ENOMEM;
+    }
+
+    memset(index->buckets, 0xff, capacity * sizeof(uint32_t));
+    index->mask = capacity - 1;
+
+    for (size_t i = 0; i < index->nimages; i++) {
+        symindex_image_t* image = &index->images[i];
+
+        for (size_t j = 0; j < image->count; j++) {
+            index->entries[index->nentries].address = (uintptr_t) image->addresses[j];
+            index->entries[index->nentries].name = image->names[j];
+            index->entries[index->nentries].image = (uint32_t) i;
+            index->nentries++;
+        }
+
+        free(image->names);
+        free(image->addresses);
+        image->names = NULL;
+        image->addresses = NULL;
+    }
+
+    qsort(index->entries, index->nentries, sizeof(symindex_entry_t), symindex_compare_entry);
+
+    for (uint32_t i = 0; i < index->nentries; i++) {
+        bucket = symindex_find_bucket(index, index->entries[i].name);
+        if (SYMINDEX_EMPTY == *bucket || index->entries[i].image < index->entries[*bucket].image) {
+            *bucket = i;
+        }
+    }
+
+    return 0;
+}
+
+int symindex_build(void) {
+    symindex_job_t job = { 0 };
+    pthread_t workers[SYMINDEX_MAX_WORKERS];
+    size_t nworkers = 0;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    symindex_t* index;
+    int rc = -1;
+
+    if (NULL != __atomic_load_n(&symindex, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    if (NULL == (index = calloc(1, sizeof(symindex_t)))) {
+        return ENOMEM;
+    }
+
+    if (0 != dl_iterate_phdr(symindex_add_image, &job)) {
+        goto error;
+    }
+
+    symindex_pin_images(&job);
+
+    // the calling thread is one of the workers
+    while (nworkers + 1 < MIN((size_t) MAX(ncpus, 1), SYMINDEX_MAX_WORKERS) && nworkers + 1 < job.nimages
+            && 0 == pthread_create(&workers[nworkers], NULL, symindex_worker, &job)) {
+        nworkers++;
+    }
+
+    symindex_worker(&job);
+
+    for (size_t i = 0; i < nworkers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    symindex_unpin_images(&job);
+
+    index->images = job.images;
+    index->nimages = job.nimages;
+    job.images = NULL;
+    job.nimages = 0;
+
+    if (0 != (rc = symindex_merge(index))) {
+        goto error;
+    }
+
+    LOGD("%zu symbols of %zu libraries indexed with %zu workers", index->nentries, index->nimages, nworkers + 1);
+    __atomic_store_n(&symindex, index, __ATOMIC_RELEASE);
+    return 0;
+
+error:
+    symindex_unpin_images(&job);
+    for (size_t i = 0; i < job.nimages; i++) {
+        free(job.images[i].pathname);
+        free(job.images[i].strings);
+        free(job.images[i].names);
+        free(job.images[i].addresses);
+    }
+    free(job.images);
+
+    for (size_t i = 0; i < index->nimages; i++) {
+        free(index->images[i].pathname);
+        free(index->images[i].strings);
+        free(index->images[i].names);
+        free(index->images[i].addresses);
+    }
+    free(index->images);
+    free(index->entries);
+    free(index->buckets);
+    free(index);
+    return rc;
+}
+
+static void* symindex_build_routine(void* arg) {
+    UNUSED(arg);
+    symindex_build();
+    return NULL;
+}
+
+int symindex_build_async(void) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    int rc;
+
+    if (__atomic_exchange_n(&symindex_started, 1, __ATOMIC_ACQ_REL)) {
+        return 0;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (0 != (rc = pthread_create(&thread, &attr, symindex_build_routine, NULL))) {
+        LOGD("failed to create thread: %s", strerror(rc));
+        __atomic_store_n(&symindex_started, 0, __ATOMIC_RELEASE);
+    }
+    pthread_attr_destroy(&attr);
+
+    return rc;
+}
+
+int symindex_is_ready(void) {
+    return NULL != __atomic_load_n(&symindex, __ATOMIC_ACQUIRE);
+}
+
+void* symindex_lookup(const char* symbol, const char** pathname) {
+    symindex_t* index = __atomic_load_n(&symindex, __ATOMIC_ACQUIRE);
+    symindex_entry_t* entry;
+    uint32_t* bucket;
+
+    if (NULL == index || SYMINDEX_EMPTY == *(bucket = symindex_find_bucket(index, symbol))) {
+        return NULL;
+    }
+
+    entry = &index->entries[*bucket];
+    if (NULL != pathname) {
+        *pathname = index->images[entry->image].pathname;
+    }
+    return (void*) entry->address;
+}
+
+int symindex_symbolize(uintptr_t address, const char** name, uintptr_t* offset, const char** pathname) {
+    symindex_t* index = __atomic_load_n(&symindex, __ATOMIC_ACQUIRE);
+    symindex_entry_t* entry;
+    symindex_image_t* image;
+    size_t lo = 0;
+    size_t hi;
+
+    if (NULL == index) {
+        return -1;
+    }
+
+    hi = index->nentries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].address <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (0 == lo) {
+        return -1;
+    }
+
+    // the nearest symbol must be in the same library
+    entry = &index->entries[lo - 1];
+    image = &index->images[entry->image];
+    if (address < image->start || address >= image->end) {
+        return -1;
+    }
+
+    if (NULL != name) {
+        *name = entry->name;
+    }
+    if (NULL != offset) {
+        *offset = address - entry->address;
+    }
+    if (NULL != pathname) {
+        *pathname = image->pathname;
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,58 @@
+#ifndef SYMINDEX_H
+#define SYMINDEX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Build the index of dynamic symbols of all loaded libraries, then publish it for
+ * <code>symindex_lookup</code> and <code>symindex_symbolize</code>
+ *
+ * The libraries are pinned while they're parsed in parallel on a small worker pool, the ones that can't be pinned,
+ * e.g. of other namespaces, are skipped. The names of symbols are copied, so that the libraries could still be
+ * unloaded after, then their addresses in the index are stale.
+ *
+ * @return 0 if succeeded
+ */
+int symindex_build(void);
+
+/**
+ * Build the index on a background thread, only the first call takes effect
+ *
+ * @return 0 if the thread is started or the index is being built
+ */
+int symindex_build_async(void);
+
+/**
+ * @return 1 if the index has been published
+ */
+int symindex_is_ready(void);
+
+/**
+ * Lookup <code>symbol</code> from any library, the first loaded one wins if it's defined by several libraries
+ *
+ * @param symbol the symbol name
+ * @param pathname the path of the library defining <code>symbol</code>, could be <code>NULL</code>
+ * @return the address of <code>symbol</code>, or <code>NULL</code> if not found or the index isn't ready
+ */
+void* symindex_lookup(const char* symbol, const char** pathname);
+
+/**
+ * Lookup the nearest symbol at or before <code>address</code> in the library containing it
+ *
+ * @param address the address, e.g. a native PC
+ * @param name the name of the symbol
+ * @param offset the offset of <code>address</code> from the symbol
+ * @param pathname the path of the library, could be <code>NULL</code>
+ * @return 0 if found
+ */
+int symindex_symbolize(uintptr_t address, const char** name, uintptr_t* offset, const char** pathname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SYMINDEX_H */
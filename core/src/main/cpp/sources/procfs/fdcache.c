@@ -0,0 +1,129 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include "defs.h"
+#include "fdcache.h"
+#include "parser.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FDCACHE_SIZE 8
+
+typedef struct procfs_fdcache_entry {
+    int fd;
+
+    /* the descriptors opened before fork refer to the parent */
+    pid_t pid;
+
+    uint64_t used;
+    char path[64];
+} procfs_fdcache_entry_t;
+
+static procfs_fdcache_entry_t procfs_fdcache[FDCACHE_SIZE];
+
+static uint64_t procfs_fdcache_clock = 0;
+
+static atomic_flag procfs_fdcache_busy = ATOMIC_FLAG_INIT;
+
+static void procfs_fdcache_evict(procfs_fdcache_entry_t* entry) {
+    if ('\0' != entry->path[0]) {
+        close(entry->fd);
+    }
+    memset(entry, 0, sizeof(*entry));
+}
+
+/**
+ * @return the cached entry of path, or the least recently used one to be replaced
+ */
+static procfs_fdcache_entry_t* procfs_fdcache_find(const char* path, pid_t pid) {
+    procfs_fdcache_entry_t* lru = &procfs_fdcache[0];
+
+    for (size_t i = 0; i < FDCACHE_SIZE; i++) {
+        procfs_fdcache_entry_t* entry = &procfs_fdcache[i];
+
+        if ('\0' != entry->path[0] && pid != entry->pid) {
+            procfs_fdcache_evict(entry);
+        }
+        if ('\0' != entry->path[0] && 0 == strcmp(entry->path, path)) {
+            return entry;
+        }
+        if (entry->used < lru->used) {
+            lru = entry;
+        }
+    }
+
+    return lru;
+}
+
+ssize_t procfs_fdcache_read(const char* path, char* buf, size_t size) {
+    procfs_fdcache_entry_t* entry;
+    pid_t pid = getpid();
+    ssize_t n = -1;
+    int fd;
+
+    if (0 == size || strlen(path) >= sizeof(entry->path)) {
+        return procfs_read(path, buf, size);
+    }
+
+    if (atomic_flag_test_and_set_explicit(&procfs_fdcache_busy, memory_order_acquire)) {
+        return procfs_read(path, buf, size);
+    }
+
+    entry = procfs_fdcache_find(path, pid);
+    if (0 == strcmp(entry->path, path)) {
+        // the thread might have exited
+        if (0 <= (n = procfs_pread(entry->fd, buf, size))) {
+            entry->used = ++procfs_fdcache_clock;
+            goto done;
+        }
+        procfs_fdcache_evict(entry);
+    }
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC)))) {
+        goto done;
+    }
+
+    if (0 > (n = procfs_pread(fd, buf, size))) {
+        close(fd);
+        goto done;
+    }
+
+    procfs_fdcache_evict(entry);
+    entry->fd = fd;
+    entry->pid = pid;
+    entry->used = ++procfs_fdcache_clock;
+    strcpy(entry->path, path);
+
+done:
+    atomic_flag_clear_explicit(&procfs_fdcache_busy, memory_order_release);
+    return n;
+}
+
+void procfs_fdcache_clear(void) {
+    while (atomic_flag_test_and_set_explicit(&procfs_fdcache_busy, memory_order_acquire)) {
+        sched_yield();
+    }
+
+    for (size_t i = 0; i < FDCACHE_SIZE; i++) {
+        procfs_fdcache_evict(&procfs_fdcache[i]);
+    }
+
+    atomic_flag_clear_explicit(&procfs_fdcache_busy, memory_order_release);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,35 @@
+#ifndef FDCACHE_H
+#define FDCACHE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A small LRU of the descriptors of procfs files which are sampled repeatedly, each of them is re-read
+ * with <code>pread</code> from offset 0, so that a sample costs one syscall instead of three, and still
+ * works when a later <code>open</code> would fail for the fd pressure or SELinux.
+ *
+ * It never allocates nor blocks, the read falls back to <code>open</code> if the cache is busy.
+ */
+
+/**
+ * Read the file through the cache, see <code>procfs_read</code>
+ *
+ * @return the length of content, or <code>-1</code> if failed
+ */
+ssize_t procfs_fdcache_read(const char* path, char* buf, size_t size);
+
+/**
+ * Close all of the cached descriptors
+ */
+void procfs_fdcache_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FDCACHE_H */
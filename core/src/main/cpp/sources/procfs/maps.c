@@ -0,0 +1,267 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "defs.h"
+#include "log.h"
+#include "maps.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAPS_INITIAL_SIZE 65536
+
+struct procfs_maps {
+    /* the content of /proc/self/maps, the paths are terminated in place */
+    char* data;
+    size_t size;
+    uint64_t digest;
+
+    /* sorted by address */
+    procfs_map_t* maps;
+    size_t count;
+
+    /* the mappings from offset 0, sorted by path then address */
+    const procfs_map_t** bases;
+    size_t nbases;
+};
+
+static uint64_t procfs_maps_digest(const char* data, size_t size) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ (uint8_t) data[i]) * 0x100000001b3;
+    }
+    return h;
+}
+
+/**
+ * Read the whole content, the buffer is one byte larger than <code>size</code> for termination
+ */
+static char* procfs_maps_read(size_t* size) {
+    size_t cap = MAPS_INITIAL_SIZE;
+    size_t n = 0;
+    ssize_t rc;
+    char* data = NULL;
+    char* tmp;
+    int fd;
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(open("/proc/self/maps", O_RDONLY | O_CLOEXEC)))) {
+        LOGD("cannot open /proc/self/maps : %s", strerror(errno));
+        return NULL;
+    }
+
+    for (;;) {
+        if (NULL == data || n == cap) {
+            cap = NULL == data ? cap : cap * 2;
+            if (NULL == (tmp = realloc(data, cap + 1))) {
+                goto error;
+            }
+            data = tmp;
+        }
+
+        if (0 > (rc = TEMP_FAILURE_RETRY(read(fd, data + n, cap - n)))) {
+            goto error;
+        }
+        if (0 == rc) {
+            break;
+        }
+        n += (size_t) rc;
+    }
+
+    close(fd);
+    data[n] = '\0';
+    *size = n;
+    return data;
+
+error:
+    close(fd);
+    free(data);
+    return NULL;
+}
+
+static int procfs_maps_compare_base(const void* a, const void* b) {
+    const procfs_map_t* x = *(const procfs_map_t* const*) a;
+    const procfs_map_t* y = *(const procfs_map_t* const*) b;
+    int rc = strcmp(x->pathname, y->pathname);
+
+    if (0 != rc) {
+        return rc;
+    }
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int procfs_maps_parse(procfs_maps_t* thiz) {
+    size_t lines = 1 + procfs_count(thiz->data, thiz->data + thiz->size, '\n');
+    procfs_tokenizer_t tokenizer;
+    procfs_token_t token;
+    procfs_map_t* map;
+    char* line;
+
+    if (NULL == (thiz->maps = calloc(lines, sizeof(procfs_map_t)))
+            || NULL == (thiz->bases = calloc(lines, sizeof(procfs_map_t*)))) {
+        return ENOMEM;
+    }
+
+    procfs_tokenizer_init(&tokenizer, thiz->data, thiz->size);
+    while (procfs_tokenizer_next_line(&tokenizer, &token)) {
+        line = thiz->data + (token.data - thiz->data);
+
+        map = &thiz->maps[thiz->count];
+        if (0 != procfs_parse_map(line, line + token.len, map)) {
+            continue;
+        }
+
+        // intern the path shared by the consecutive mappings
+        if (thiz->count > 0 && 0 == strcmp(thiz->maps[thiz->count - 1].pathname, map->pathname)) {
+            map->pathname = thiz->maps[thiz->count - 1].pathname;
+        }
+
+        thiz->count++;
+    }
+
+    // the kernel reports in the order of address already
+    for (size_t i = 0; i < thiz->count; i++) {
+        if (0 == thiz->maps[i].offset && '\0' != thiz->maps[i].pathname[0]) {
+            thiz->bases[thiz->nbases++] = &thiz->maps[i];
+        }
+    }
+
+    qsort(thiz->bases, thiz->nbases, sizeof(procfs_map_t*), procfs_maps_compare_base);
+    return 0;
+}
+
+static void procfs_maps_reset(procfs_maps_t* thiz) {
+    free(thiz->data);
+    free(thiz->maps);
+    free(thiz->bases);
+    memset(thiz, 0, sizeof(*thiz));
+}
+
+procfs_maps_t* procfs_maps_open(void) {
+    procfs_maps_t* thiz = calloc(1, sizeof(procfs_maps_t));
+
+    if (NULL != thiz && 0 > procfs_maps_refresh(thiz)) {
+        procfs_maps_close(&thiz);
+    }
+
+    return thiz;
+}
+
+int procfs_maps_refresh(procfs_maps_t* thiz) {
+    size_t size;
+    uint64_t digest;
+    char* data;
+
+    if (NULL == (data = procfs_maps_read(&size))) {
+        return -1;
+    }
+
+    digest = procfs_maps_digest(data, size);
+    if (NULL != thiz->data && size == thiz->size && digest == thiz->digest) {
+        free(data);
+        return 0;
+    }
+
+    procfs_maps_reset(thiz);
+    thiz->data = data;
+    thiz->size = size;
+    thiz->digest = digest;
+
+    if (0 != procfs_maps_parse(thiz)) {
+        procfs_maps_reset(thiz);
+        return -1;
+    }
+
+    LOGD("%zu mappings indexed", thiz->count);
+    return 1;
+}
+
+size_t procfs_maps_get_count(procfs_maps_t* thiz) {
+    return thiz->count;
+}
+
+const procfs_map_t* procfs_maps_get(procfs_maps_t* thiz, size_t index) {
+    return index < thiz->count ? &thiz->maps[index] : NULL;
+}
+
+const procfs_map_t* procfs_maps_find(procfs_maps_t* thiz, uintptr_t address) {
+    size_t lo = 0;
+    size_t hi = thiz->count;
+
+    // the last mapping starts at or before address
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (thiz->maps[mid].start <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (0 == lo || address >= thiz->maps[lo - 1].end) {
+        return NULL;
+    }
+
+    return &thiz->maps[lo - 1];
+}
+
+int procfs_maps_get_address(procfs_maps_t* thiz, const char* pathname, uintptr_t* address) {
+    size_t lo = 0;
+    size_t hi = thiz->nbases;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(thiz->bases[mid]->pathname, pathname) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo >= thiz->nbases || 0 != strcmp(thiz->bases[lo]->pathname, pathname)) {
+        return -1;
+    }
+
+    *address = thiz->bases[lo]->start;
+    return 0;
+}
+
+size_t procfs_maps_get_addresses(procfs_maps_t* thiz, const char** pathnames, uintptr_t* addresses, size_t count) {
+    size_t unmapped = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (0 != procfs_maps_get_address(thiz, pathnames[i], &addresses[i])) {
+            addresses[i] = 0;
+            unmapped++;
+        }
+    }
+
+    return unmapped;
+}
+
+void procfs_maps_close(procfs_maps_t** thiz) {
+    if (NULL == thiz || NULL == *thiz) {
+        return;
+    }
+
+    procfs_maps_reset(*thiz);
+    free(*thiz);
+    *thiz = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,85 @@
+#ifndef MAPS_H
+#define MAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct procfs_maps procfs_maps_t;
+
+/**
+ * Parse <code>/proc/self/maps</code> into an index sorted by address and by path, the consecutive
+ * mappings of the same file share the same path pointer
+ *
+ * @return the pointer of <code>procfs_maps_t</code>, or <code>NULL</code> if failed
+ */
+procfs_maps_t* procfs_maps_open(void);
+
+/**
+ * Re-read <code>/proc/self/maps</code>, the index is rebuilt only if the content changed
+ *
+ * The whole file is still read and hashed to tell, so it saves the parse rather than the I/O.
+ * The mappings returned before are invalidated if the index is rebuilt.
+ *
+ * @param thiz a pointer of <code>procfs_maps_t</code>
+ * @return 1 if rebuilt, 0 if unchanged, otherwise failed
+ */
+int procfs_maps_refresh(procfs_maps_t* thiz);
+
+/**
+ * @return the number of mappings
+ */
+size_t procfs_maps_get_count(procfs_maps_t* thiz);
+
+/**
+ * @return the mapping at <code>index</code> in the order of address
+ */
+const procfs_map_t* procfs_maps_get(procfs_maps_t* thiz, size_t index);
+
+/**
+ * Lookup the mapping containing <code>address</code>
+ *
+ * @param thiz a pointer of <code>procfs_maps_t</code>
+ * @param address the address
+ * @return the mapping, or <code>NULL</code> if not mapped
+ */
+const procfs_map_t* procfs_maps_find(procfs_maps_t* thiz, uintptr_t address);
+
+/**
+ * Lookup the address of the first mapping of <code>pathname</code> from offset 0
+ *
+ * @param thiz a pointer of <code>procfs_maps_t</code>
+ * @param pathname the path of the mapped file
+ * @param address the base address
+ * @return 0 if found
+ */
+int procfs_maps_get_address(procfs_maps_t* thiz, const char* pathname, uintptr_t* address);
+
+/**
+ * Lookup the base addresses of <code>pathnames</code> in one pass
+ *
+ * @param thiz a pointer of <code>procfs_maps_t</code>
+ * @param pathnames the paths of the mapped files
+ * @param addresses the base addresses associated with <code>pathnames</code>, 0 for unmapped ones
+ * @param count the number of <code>pathnames</code>
+ * @return the number of unmapped <code>pathnames</code>
+ */
+size_t procfs_maps_get_addresses(procfs_maps_t* thiz, const char** pathnames, uintptr_t* addresses, size_t count);
+
+/**
+ * Release the index
+ *
+ * @param thiz the address of <code>procfs_maps_t</code> pointer
+ */
+void procfs_maps_close(procfs_maps_t** thiz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MAPS_H */
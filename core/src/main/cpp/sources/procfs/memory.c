@@ -0,0 +1,152 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "defs.h"
+#include "memory.h"
+#include "parser.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct procfs_smaps {
+    procfs_footprint_t* footprint;
+    procfs_memory_usage_t* current;
+} procfs_smaps_t;
+
+static const struct {
+    const char* key;
+    size_t offset;
+} procfs_memory_fields[] = {
+    { "Rss", offsetof(procfs_memory_usage_t, rss) },
+    { "Pss", offsetof(procfs_memory_usage_t, pss) },
+    { "Pss_Anon", offsetof(procfs_memory_usage_t, pss_anon) },
+    { "Pss_File", offsetof(procfs_memory_usage_t, pss_file) },
+    { "Shared_Clean", offsetof(procfs_memory_usage_t, shared_clean) },
+    { "Shared_Dirty", offsetof(procfs_memory_usage_t, shared_dirty) },
+    { "Private_Clean", offsetof(procfs_memory_usage_t, private_clean) },
+    { "Private_Dirty", offsetof(procfs_memory_usage_t, private_dirty) },
+    { "Swap", offsetof(procfs_memory_usage_t, swap) },
+    { "SwapPss", offsetof(procfs_memory_usage_t, swap_pss) },
+};
+
+static const char* const procfs_memory_category_names[PROCFS_MEMORY_CATEGORIES] = {
+    [PROCFS_MEMORY_DALVIK] = "dalvik",
+    [PROCFS_MEMORY_SO]     = ".so",
+    [PROCFS_MEMORY_OAT]    = ".oat",
+    [PROCFS_MEMORY_ANON]   = "anon",
+    [PROCFS_MEMORY_STACK]  = "stack",
+    [PROCFS_MEMORY_OTHER]  = "other",
+};
+
+const char* procfs_memory_category_name(int category) {
+    return category >= 0 && category < PROCFS_MEMORY_CATEGORIES ? procfs_memory_category_names[category] : NULL;
+}
+
+static int procfs_memory_starts_with(const char* str, const char* prefix) {
+    return 0 == strncmp(str, prefix, strlen(prefix));
+}
+
+static int procfs_memory_ends_with(const char* str, size_t len, const char* suffix) {
+    size_t n = strlen(suffix);
+    return len >= n && 0 == memcmp(str + len - n, suffix, n);
+}
+
+static int procfs_memory_categorize(const char* pathname) {
+    size_t len = strlen(pathname);
+
+    if (procfs_memory_starts_with(pathname, "[anon:dalvik-") || procfs_memory_starts_with(pathname, "/dev/ashmem/dalvik-")) {
+        return PROCFS_MEMORY_DALVIK;
+    }
+    if (procfs_memory_starts_with(pathname, "[stack") || procfs_memory_starts_with(pathname, "[anon:stack_and_tls:")) {
+        return PROCFS_MEMORY_STACK;
+    }
+    if (procfs_memory_ends_with(pathname, len, ".so") || NULL != strstr(pathname, ".so.")) {
+        return PROCFS_MEMORY_SO;
+    }
+    if (procfs_memory_ends_with(pathname, len, ".oat") || procfs_memory_ends_with(pathname, len, ".odex")
+            || procfs_memory_ends_with(pathname, len, ".vdex") || procfs_memory_ends_with(pathname, len, ".art")) {
+        return PROCFS_MEMORY_OAT;
+    }
+    if ('\0' == *pathname || procfs_memory_starts_with(pathname, "[anon:") || 0 == strcmp(pathname, "[heap]")) {
+        return PROCFS_MEMORY_ANON;
+    }
+    return PROCFS_MEMORY_OTHER;
+}
+
+/**
+ * Get the counter at <code>offset</code> of <code>usage</code>, which is one of the fields above
+ */
+static uint64_t* procfs_memory_field(procfs_memory_usage_t* usage, size_t offset) {
+    return (void*) ((uint8_t*) usage + offset);
+}
+
+/**
+ * The mapping header starts a new mapping, and the fields like <code>Rss:  12 kB</code> are accumulated to it
+ */
+static int procfs_visit_smaps(char* line, char* eol, void* data) {
+    procfs_smaps_t* smaps = data;
+    const char* colon;
+    const char* p;
+    procfs_map_t map;
+    int64_t value;
+
+    if (NULL == (colon = memchr(line, ':', (size_t) (eol - line)))) {
+        return 0;
+    }
+
+    // the fields start with an upper case letter, which isn't a hexadecimal digit of the mapping
+    if (*line < 'A' || *line > 'Z') {
+        if (0 == procfs_parse_map(line, eol, &map)) {
+            smaps->current = &smaps->footprint->categories[procfs_memory_categorize(map.pathname)];
+        }
+        return 0;
+    }
+
+    for (p = colon + 1; p < eol && ' ' == *p; p++) {
+        continue;
+    }
+
+    if (NULL == procfs_parse_dec(p, eol, &value)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(procfs_memory_fields); i++) {
+        if ((size_t) (colon - line) == strlen(procfs_memory_fields[i].key) && 0 == memcmp(line, procfs_memory_fields[i].key, (size_t) (colon - line))) {
+            *procfs_memory_field(&smaps->footprint->total, procfs_memory_fields[i].offset) += (uint64_t) value;
+            if (NULL != smaps->current) {
+                *procfs_memory_field(smaps->current, procfs_memory_fields[i].offset) += (uint64_t) value;
+            }
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int procfs_read_footprint(char* buf, size_t size, procfs_footprint_t* footprint) {
+    procfs_smaps_t smaps = { .footprint = footprint };
+
+    memset(footprint, 0, sizeof(*footprint));
+
+    // available since Linux 4.14, summed up by the kernel
+    footprint->rollup = 1;
+    if (0 == procfs_scan_lines("/proc/self/smaps_rollup", buf, size, procfs_visit_smaps, &smaps)) {
+        memset(footprint->categories, 0, sizeof(footprint->categories));
+        return 0;
+    }
+
+    memset(footprint, 0, sizeof(*footprint));
+    smaps.current = NULL;
+    return procfs_scan_lines("/proc/self/smaps", buf, size, procfs_visit_smaps, &smaps);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,69 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The categories of mappings aggregated from <code>/proc/self/smaps</code>
+ */
+enum {
+    PROCFS_MEMORY_DALVIK,
+    PROCFS_MEMORY_SO,
+    PROCFS_MEMORY_OAT,
+    PROCFS_MEMORY_ANON,
+    PROCFS_MEMORY_STACK,
+    PROCFS_MEMORY_OTHER,
+    PROCFS_MEMORY_CATEGORIES,
+};
+
+/**
+ * The memory usage in KiB
+ */
+typedef struct procfs_memory_usage {
+    uint64_t rss;
+    uint64_t pss;
+    uint64_t pss_anon;
+    uint64_t pss_file;
+    uint64_t shared_clean;
+    uint64_t shared_dirty;
+    uint64_t private_clean;
+    uint64_t private_dirty;
+    uint64_t swap;
+    uint64_t swap_pss;
+} procfs_memory_usage_t;
+
+/**
+ * The memory footprint of the current process
+ */
+typedef struct procfs_footprint {
+    /* 1 if it's read from smaps_rollup, which has no categories */
+    int rollup;
+    procfs_memory_usage_t total;
+    procfs_memory_usage_t categories[PROCFS_MEMORY_CATEGORIES];
+} procfs_footprint_t;
+
+/**
+ * @return the name of category
+ */
+const char* procfs_memory_category_name(int category);
+
+/**
+ * Read the memory footprint from <code>/proc/self/smaps_rollup</code>, or aggregate <code>/proc/self/smaps</code>
+ * by category if it's unavailable, both of them are streamed through <code>buf</code>
+ *
+ * @param buf the buffer which must hold the longest line
+ * @param size the size of <code>buf</code>
+ * @return 0 if succeeded
+ */
+int procfs_read_footprint(char* buf, size_t size, procfs_footprint_t* footprint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEMORY_H */
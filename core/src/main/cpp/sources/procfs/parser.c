@@ -0,0 +1,472 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/param.h>
+
+#include "defs.h"
+#include "fdcache.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STAT_MAX_FIELDS 52
+
+static char* procfs_append(char* p, char* end, const char* str) {
+    while (NULL != p && '\0' != *str) {
+        if (p >= end) {
+            return NULL;
+        }
+        *p++ = *str++;
+    }
+    return p;
+}
+
+static char* procfs_append_dec(char* p, char* end, uint64_t value) {
+    char digits[20];
+    size_t n = 0;
+
+    do {
+        digits[n++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (0 != value);
+
+    while (NULL != p && n > 0) {
+        if (p >= end) {
+            return NULL;
+        }
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+char* procfs_format_path(char* buf, size_t size, pid_t tid, const char* name) {
+    char* end = buf + size - 1;
+    char* p = buf;
+
+    if (0 == size) {
+        return NULL;
+    }
+
+    if (tid > 0) {
+        p = procfs_append(p, end, "/proc/self/task/");
+        p = procfs_append_dec(p, end, (uint64_t) tid);
+        p = procfs_append(p, end, "/");
+    } else {
+        p = procfs_append(p, end, "/proc/self/");
+    }
+    p = procfs_append(p, end, name);
+
+    if (NULL == p) {
+        return NULL;
+    }
+
+    *p = '\0';
+    return buf;
+}
+
+char* procfs_format_task_path(char* buf, size_t size, pid_t tid, const char* name) {
+    char* end = buf + size - 1;
+    char* p = buf;
+
+    if (0 == size) {
+        return NULL;
+    }
+
+    p = procfs_append_dec(p, end, (uint64_t) tid);
+    p = procfs_append(p, end, "/");
+    p = procfs_append(p, end, name);
+
+    if (NULL == p) {
+        return NULL;
+    }
+
+    *p = '\0';
+    return buf;
+}
+
+ssize_t procfs_read(const char* path, char* buf, size_t size) {
+    return procfs_read_at(AT_FDCWD, path, buf, size);
+}
+
+ssize_t procfs_read_at(int dirfd, const char* path, char* buf, size_t size) {
+    ssize_t n;
+    int fd;
+
+    if (0 == size || 0 > (fd = TEMP_FAILURE_RETRY(openat(dirfd, path, O_RDONLY | O_CLOEXEC)))) {
+        return -1;
+    }
+
+    n = procfs_pread(fd, buf, size);
+    close(fd);
+    return n;
+}
+
+ssize_t procfs_pread(int fd, char* buf, size_t size) {
+    size_t n = 0;
+    ssize_t rc;
+
+    if (0 == size) {
+        return -1;
+    }
+
+    // procfs might return less than requested before EOF
+    while (n < size - 1) {
+        if (0 > (rc = TEMP_FAILURE_RETRY(pread(fd, buf + n, size - 1 - n, (off_t) n)))) {
+            return -1;
+        }
+        if (0 == rc) {
+            break;
+        }
+        n += (size_t) rc;
+    }
+
+    buf[n] = '\0';
+    return (ssize_t) n;
+}
+
+ssize_t procfs_read_task(pid_t tid, const char* name, char* buf, size_t size) {
+    char path[64];
+
+    if (NULL == procfs_format_path(path, sizeof(path), tid, name)) {
+        return -1;
+    }
+
+    // sampled repeatedly
+    if (tid <= 0 || tid == getpid()) {
+        return procfs_fdcache_read(path, buf, size);
+    }
+
+    return procfs_read(path, buf, size);
+}
+
+const char* procfs_parse_hex(const char* p, const char* end, uint64_t* value) {
+    const char* begin = p;
+    uint64_t v = 0;
+
+    for (; p < end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            v = (v << 4) | (uint64_t) (*p - '0');
+        } else if (*p >= 'a' && *p <= 'f') {
+            v = (v << 4) | (uint64_t) (*p - 'a' + 10);
+        } else {
+            break;
+        }
+    }
+
+    *value = v;
+    return p > begin ? p : NULL;
+}
+
+const char* procfs_parse_dec(const char* p, const char* end, int64_t* value) {
+    const char* begin;
+    uint64_t v = 0;
+    int negative = p < end && '-' == *p;
+
+    begin = p += negative;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        v = v * 10 + (uint64_t) (*p - '0');
+    }
+
+    *value = negative ? -(int64_t) v : (int64_t) v;
+    return p > begin ? p : NULL;
+}
+
+/**
+ * <pre>
+ * address               perm offset   dev   inode                          pathname
+ * 7340f11000-7340ff3000 r-xp 00000000 fd:00 1951                           /system/lib64/libc++.so
+ * </pre>
+ */
+int procfs_parse_map(char* line, char* end, procfs_map_t* map) {
+    const char* p = line;
+    uint64_t value;
+    int64_t inode;
+    char* path;
+
+    if (NULL == (p = procfs_parse_hex(p, end, &value)) || p >= end || '-' != *p++) {
+        return -1;
+    }
+    map->start = (uintptr_t) value;
+
+    if (NULL == (p = procfs_parse_hex(p, end, &value)) || p >= end || ' ' != *p++ || p + 5 > end || ' ' != p[4]) {
+        return -1;
+    }
+    map->end = (uintptr_t) value;
+
+    memcpy(map->perms, p, 4);
+    map->perms[4] = '\0';
+    p += 5;
+
+    if (NULL == (p = procfs_parse_hex(p, end, &value)) || p >= end || ' ' != *p++) {
+        return -1;
+    }
+    map->offset = (uintptr_t) value;
+
+    // dev
+    if (NULL == (p = procfs_parse_hex(p, end, &value)) || p >= end || ':' != *p++
+            || NULL == (p = procfs_parse_hex(p, end, &value)) || p >= end || ' ' != *p++
+            || NULL == (p = procfs_parse_dec(p, end, &inode))) {
+        return -1;
+    }
+    map->inode = (uint64_t) inode;
+
+    while (p < end && ' ' == *p) {
+        p++;
+    }
+
+    path = line + (p - line);
+    while (end > path && (' ' == end[-1] || '\t' == end[-1])) {
+        end--;
+    }
+    *end = '\0';
+
+    map->pathname = path;
+    return 0;
+}
+
+int procfs_scan_lines(const char* path, char* buf, size_t size, int (*visit)(char* line, char* eol, void* data), void* data) {
+    size_t n = 0;
+    ssize_t rc;
+    int skipping = 0;
+    int eof = 0;
+    int stop = 0;
+    const char* found;
+    char* line;
+    char* eol;
+    int fd;
+
+    if (size < 2 || 0 > (fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC)))) {
+        return -1;
+    }
+
+    while (!eof && 0 == stop) {
+        if (0 > (rc = TEMP_FAILURE_RETRY(read(fd, buf + n, size - 1 - n)))) {
+            stop = -1;
+            break;
+        }
+        eof = 0 == rc;
+        n += (size_t) rc;
+
+        for (line = buf; 0 == stop && line < buf + n; line = eol + 1) {
+            if (NULL == (found = procfs_find(line, buf + n, '\n'))) {
+                if (!eof) {
+                    break;
+                }
+                found = buf + n;
+            }
+            eol = line + (found - line);
+
+            // the rest of the line longer than buffer
+            if (skipping) {
+                skipping = 0;
+                continue;
+            }
+
+            stop = visit(line, eol, data);
+        }
+
+        if (line < buf + n) {
+            n = (size_t) (buf + n - line);
+            memmove(buf, line, n);
+        } else {
+            n = 0;
+        }
+
+        if (n == size - 1) {
+            skipping = 1;
+            n = 0;
+        }
+    }
+
+    close(fd);
+    return stop;
+}
+
+typedef struct procfs_maps_visitor {
+    int (*visit)(const procfs_map_t* map, void* data);
+    void* data;
+} procfs_maps_visitor_t;
+
+static int procfs_visit_map(char* line, char* eol, void* data) {
+    procfs_maps_visitor_t* visitor = data;
+    procfs_map_t map;
+
+    if (0 != procfs_parse_map(line, eol, &map)) {
+        return 0;
+    }
+
+    return visitor->visit(&map, visitor->data);
+}
+
+int procfs_scan_maps(char* buf, size_t size, int (*visit)(const procfs_map_t* map, void* data), void* data) {
+    procfs_maps_visitor_t visitor = { .visit = visit, .data = data };
+    return procfs_scan_lines("/proc/self/maps", buf, size, procfs_visit_map, &visitor);
+}
+
+ssize_t procfs_read_comm(pid_t tid, char* buf, size_t size) {
+    ssize_t n;
+
+    if (0 > (n = procfs_read_task(tid, "comm", buf, size))) {
+        return -1;
+    }
+
+    while (n > 0 && ('\n' == buf[n - 1] || ' ' == buf[n - 1])) {
+        buf[--n] = '\0';
+    }
+    return n;
+}
+
+int procfs_read_status(pid_t tid, char* buf, size_t size, procfs_status_t* status) {
+    ssize_t n;
+
+    if (0 > (n = procfs_read_task(tid, "status", buf, size))) {
+        return -1;
+    }
+
+    return procfs_parse_status(buf, (size_t) n, status);
+}
+
+int procfs_parse_status(const char* buf, size_t len, procfs_status_t* status) {
+    procfs_tokenizer_t tokenizer;
+    procfs_token_t line;
+    procfs_token_t key;
+    procfs_token_t value;
+    const char* eol;
+    const char* v;
+    uint64_t hex;
+    int64_t dec;
+
+    memset(status, 0, sizeof(*status));
+    procfs_tokenizer_init(&tokenizer, buf, len);
+
+    while (procfs_tokenizer_next_line(&tokenizer, &line)) {
+        if (0 != procfs_token_split(&line, ':', &key, &value)) {
+            continue;
+        }
+
+        v = value.data;
+        eol = value.data + value.len;
+
+        if (procfs_token_equals(&key, "Name")) {
+            size_t n = MIN((size_t) (eol - v), sizeof(status->name) - 1);
+            memcpy(status->name, v, n);
+            status->name[n] = '\0';
+        } else if (procfs_token_equals(&key, "State")) {
+            status->state = v < eol ? *v : '\0';
+        } else if (procfs_token_equals(&key, "Tgid") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->tgid = (pid_t) dec;
+        } else if (procfs_token_equals(&key, "Pid") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->pid = (pid_t) dec;
+        } else if (procfs_token_equals(&key, "PPid") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->ppid = (pid_t) dec;
+        } else if (procfs_token_equals(&key, "TracerPid") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->tracer_pid = (pid_t) dec;
+        } else if (procfs_token_equals(&key, "Threads") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->threads = (uint32_t) dec;
+        } else if (procfs_token_equals(&key, "SigPnd") && NULL != procfs_parse_hex(v, eol, &hex)) {
+            status->sig_pnd = hex;
+        } else if (procfs_token_equals(&key, "ShdPnd") && NULL != procfs_parse_hex(v, eol, &hex)) {
+            status->shd_pnd = hex;
+        } else if (procfs_token_equals(&key, "SigBlk") && NULL != procfs_parse_hex(v, eol, &hex)) {
+            status->sig_blk = hex;
+        } else if (procfs_token_equals(&key, "SigIgn") && NULL != procfs_parse_hex(v, eol, &hex)) {
+            status->sig_ign = hex;
+        } else if (procfs_token_equals(&key, "SigCgt") && NULL != procfs_parse_hex(v, eol, &hex)) {
+            status->sig_cgt = hex;
+        } else if (procfs_token_equals(&key, "VmRSS") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->vm_rss_kb = (uint64_t) dec;
+        } else if (procfs_token_equals(&key, "VmHWM") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->vm_hwm_kb = (uint64_t) dec;
+        } else if (procfs_token_equals(&key, "voluntary_ctxt_switches") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->voluntary_ctxt_switches = (uint64_t) dec;
+        } else if (procfs_token_equals(&key, "nonvoluntary_ctxt_switches") && NULL != procfs_parse_dec(v, eol, &dec)) {
+            status->nonvoluntary_ctxt_switches = (uint64_t) dec;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * <pre>
+ * pid (comm) state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt utime stime ...
+ * </pre>
+ */
+int procfs_parse_stat(const char* buf, size_t len, procfs_stat_t* stat) {
+    int64_t fields[STAT_MAX_FIELDS + 1];
+    size_t nfields = 3;
+    const char* comm;
+    const char* p;
+    const char* end = buf + len;
+    int64_t pid;
+
+    // the name might contain spaces and parentheses
+    if (NULL == (p = procfs_parse_dec(buf, end, &pid)) || p + 2 > end || ' ' != p[0] || '(' != p[1]) {
+        return -1;
+    }
+    comm = p + 2;
+
+    for (p = end; p > comm && ')' != p[-1];) {
+        p--;
+    }
+    if (p <= comm || p + 2 >= end) {
+        return -1;
+    }
+
+    memset(stat, 0, sizeof(*stat));
+    stat->pid = (pid_t) pid;
+    memcpy(stat->comm, comm, MIN((size_t) (p - 1 - comm), sizeof(stat->comm) - 1));
+    stat->state = p[1];
+
+    memset(fields, 0, sizeof(fields));
+    for (p += 2; p < end && nfields < STAT_MAX_FIELDS; nfields++) {
+        while (p < end && ' ' == *p) {
+            p++;
+        }
+        if (NULL == (p = procfs_parse_dec(p, end, &fields[nfields + 1]))) {
+            break;
+        }
+    }
+
+    // the indices are 1-based as documented in proc(5)
+    stat->ppid = (pid_t) fields[4];
+    stat->minflt = (uint64_t) fields[10];
+    stat->majflt = (uint64_t) fields[12];
+    stat->utime = (uint64_t) fields[14];
+    stat->stime = (uint64_t) fields[15];
+    stat->priority = fields[18];
+    stat->nice = fields[19];
+    stat->num_threads = fields[20];
+    stat->starttime = (uint64_t) fields[22];
+    stat->vsize = (uint64_t) fields[23];
+    stat->rss = (uint64_t) fields[24];
+    stat->processor = fields[39];
+    stat->policy = (uint64_t) fields[41];
+    stat->blkio_ticks = (uint64_t) fields[42];
+    return 0;
+}
+
+int procfs_read_stat(pid_t tid, char* buf, size_t size, procfs_stat_t* stat) {
+    ssize_t n;
+
+    if (0 > (n = procfs_read_task(tid, "stat", buf, size))) {
+        return -1;
+    }
+
+    return procfs_parse_stat(buf, (size_t) n, stat);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
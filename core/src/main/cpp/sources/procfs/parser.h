@@ -0,0 +1,206 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The parsers of procfs over raw <code>read</code> into the caller supplied buffer, which never allocate,
+ * never lock and never touch stdio, so that they are safe to be called from signal handlers, or while the
+ * other threads are suspended.
+ */
+
+/**
+ * A line of <code>/proc/self/maps</code>
+ */
+typedef struct procfs_map {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t offset;
+    uint64_t inode;
+    char perms[5];
+
+    /* points into the parsed buffer */
+    const char* pathname;
+} procfs_map_t;
+
+/**
+ * The fields of <code>/proc/[pid]/task/[tid]/status</code>
+ */
+typedef struct procfs_status {
+    char name[16];
+    char state;
+    pid_t tgid;
+    pid_t pid;
+    pid_t ppid;
+    pid_t tracer_pid;
+    uint32_t threads;
+    uint64_t sig_pnd;
+    uint64_t shd_pnd;
+    uint64_t sig_blk;
+    uint64_t sig_ign;
+    uint64_t sig_cgt;
+    uint64_t vm_rss_kb;
+    uint64_t vm_hwm_kb;
+    uint64_t voluntary_ctxt_switches;
+    uint64_t nonvoluntary_ctxt_switches;
+} procfs_status_t;
+
+/**
+ * The fields of <code>/proc/[pid]/task/[tid]/stat</code>
+ */
+typedef struct procfs_stat {
+    pid_t pid;
+    char comm[16];
+    char state;
+    pid_t ppid;
+    uint64_t minflt;
+    uint64_t majflt;
+    uint64_t utime;
+    uint64_t stime;
+    int64_t priority;
+    int64_t nice;
+    int64_t num_threads;
+    uint64_t starttime;
+    uint64_t vsize;
+    uint64_t rss;
+    int64_t processor;
+    uint64_t policy;
+    uint64_t blkio_ticks;
+} procfs_stat_t;
+
+/**
+ * Format <code>/proc/self/task/[tid]/[name]</code>, or <code>/proc/self/[name]</code> if <code>tid</code> isn't positive
+ *
+ * @return <code>buf</code>, or <code>NULL</code> if it's too small
+ */
+char* procfs_format_path(char* buf, size_t size, pid_t tid, const char* name);
+
+/**
+ * Format <code>[tid]/[name]</code>, which is relative to <code>/proc/self/task</code>
+ *
+ * @return <code>buf</code>, or <code>NULL</code> if it's too small
+ */
+char* procfs_format_task_path(char* buf, size_t size, pid_t tid, const char* name);
+
+/**
+ * Read the file into <code>buf</code> with the trailing <code>'\0'</code>, the content is truncated to the buffer
+ *
+ * @return the length of content, or <code>-1</code> if failed
+ */
+ssize_t procfs_read(const char* path, char* buf, size_t size);
+
+/**
+ * Read the file relative to the directory <code>dirfd</code>, see <code>procfs_read</code>
+ *
+ * @return the length of content, or <code>-1</code> if failed
+ */
+ssize_t procfs_read_at(int dirfd, const char* path, char* buf, size_t size);
+
+/**
+ * Read the opened file from offset 0 into <code>buf</code> with the trailing <code>'\0'</code>, so that
+ * the descriptor could be kept for the later reads
+ *
+ * @return the length of content, or <code>-1</code> if failed
+ */
+ssize_t procfs_pread(int fd, char* buf, size_t size);
+
+/**
+ * Read <code>/proc/self/task/[tid]/[name]</code>, or <code>/proc/self/[name]</code> if <code>tid</code> isn't positive,
+ * the files of the process and its main thread are read through the descriptor cache
+ *
+ * @return the length of content, or <code>-1</code> if failed
+ */
+ssize_t procfs_read_task(pid_t tid, const char* name, char* buf, size_t size);
+
+/**
+ * Parse the lower case hexadecimal number at <code>p</code>
+ *
+ * @return the end of number, or <code>NULL</code> if there is no digit
+ */
+const char* procfs_parse_hex(const char* p, const char* end, uint64_t* value);
+
+/**
+ * Parse the decimal number at <code>p</code>, which might be negative
+ *
+ * @return the end of number, or <code>NULL</code> if there is no digit
+ */
+const char* procfs_parse_dec(const char* p, const char* end, int64_t* value);
+
+/**
+ * Parse a line of <code>/proc/self/maps</code>, the path is terminated at <code>end</code> in place
+ *
+ * @return 0 if succeeded
+ */
+int procfs_parse_map(char* line, char* end, procfs_map_t* map);
+
+/**
+ * Visit the lines of file streamed through <code>buf</code>, the lines longer than <code>buf</code> are skipped
+ *
+ * @param path the path of file
+ * @param buf the buffer
+ * @param size the size of <code>buf</code>
+ * @param visit the visitor with the line in <code>[line, eol)</code> which could be modified in place, returns non-zero to stop
+ * @param data the data passed to <code>visit</code>
+ * @return the value returned by <code>visit</code> if stopped, 0 if all visited, otherwise <code>-1</code>
+ */
+int procfs_scan_lines(const char* path, char* buf, size_t size, int (*visit)(char* line, char* eol, void* data), void* data);
+
+/**
+ * Visit the mappings of <code>/proc/self/maps</code> streamed through <code>buf</code>, which must hold the longest line
+ *
+ * @param buf the buffer
+ * @param size the size of <code>buf</code>
+ * @param visit the visitor, returns non-zero to stop
+ * @param data the data passed to <code>visit</code>
+ * @return the value returned by <code>visit</code> if stopped, 0 if all visited, otherwise <code>-1</code>
+ */
+int procfs_scan_maps(char* buf, size_t size, int (*visit)(const procfs_map_t* map, void* data), void* data);
+
+/**
+ * Read the name of thread <code>tid</code> without the trailing line feed
+ *
+ * @return the length of name, or <code>-1</code> if failed
+ */
+ssize_t procfs_read_comm(pid_t tid, char* buf, size_t size);
+
+/**
+ * Read the status of thread <code>tid</code>, or the process if <code>tid</code> isn't positive
+ *
+ * @param buf the buffer of content, 2 KiB is large enough
+ * @return 0 if succeeded
+ */
+int procfs_read_status(pid_t tid, char* buf, size_t size, procfs_status_t* status);
+
+/**
+ * Parse the content of <code>status</code>
+ *
+ * @return 0 if succeeded
+ */
+int procfs_parse_status(const char* buf, size_t len, procfs_status_t* status);
+
+/**
+ * Read the stat of thread <code>tid</code>, or the process if <code>tid</code> isn't positive
+ *
+ * @param buf the buffer of content, 512 bytes is large enough
+ * @return 0 if succeeded
+ */
+int procfs_read_stat(pid_t tid, char* buf, size_t size, procfs_stat_t* stat);
+
+/**
+ * Parse the content of <code>stat</code>
+ *
+ * @return 0 if succeeded
+ */
+int procfs_parse_stat(const char* buf, size_t len, procfs_stat_t* stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PARSER_H */
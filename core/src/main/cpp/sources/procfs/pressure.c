@@ -0,0 +1,488 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "defs.h"
+#include "log.h"
+#include "parser.h"
+#include "pressure.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PRESSURE_RING_SIZE 512
+
+#define PRESSURE_UNAVAILABLE UINT32_MAX
+
+typedef struct pressure_slot {
+    /* odd while the sample is being written */
+    atomic_uint seq;
+    pressure_sample_t sample;
+} pressure_slot_t;
+
+typedef struct pressure_sampler {
+    uint32_t interval_ms;
+
+    int psi[PRESSURE_RESOURCES];
+    int meminfo;
+    int loadavg;
+    int cpufreq[PRESSURE_MAX_CPUS];
+    int thermal[PRESSURE_MAX_ZONES];
+
+    /* the previous stall totals for delta encoding */
+    int primed;
+    uint64_t some_total[PRESSURE_RESOURCES];
+    uint64_t full_total[PRESSURE_RESOURCES];
+} pressure_sampler_t;
+
+static pressure_slot_t pressure_ring[PRESSURE_RING_SIZE];
+
+/* the number of samples ever written */
+static atomic_uint_fast64_t pressure_head = 0;
+
+static pressure_sampler_t pressure_sampler;
+
+static pthread_mutex_t pressure_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int pressure_started = 0;
+
+static const char* const pressure_psi_paths[PRESSURE_RESOURCES] = {
+    [PRESSURE_CPU]    = "/proc/pressure/cpu",
+    [PRESSURE_MEMORY] = "/proc/pressure/memory",
+    [PRESSURE_IO]     = "/proc/pressure/io",
+};
+
+static uint64_t pressure_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static int pressure_open(const char* path) {
+    return TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+}
+
+/**
+ * Parse the fixed point number like <code>12.34</code> in 1/100
+ */
+static const char* pressure_parse_fixed(const char* p, const char* end, uint32_t* value) {
+    int64_t integer;
+    uint32_t fraction = 0;
+    int digits = 0;
+
+    if (NULL == (p = procfs_parse_dec(p, end, &integer)) || integer < 0) {
+        return NULL;
+    }
+
+    if (p < end && '.' == *p) {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            if (digits < 2) {
+                fraction = fraction * 10 + (uint32_t) (*p - '0');
+            }
+        }
+    }
+
+    for (; digits < 2; digits++) {
+        fraction *= 10;
+    }
+
+    *value = (uint32_t) integer * 100 + fraction;
+    return p;
+}
+
+/**
+ * Find <code>key</code> in the text, and returns the position right after it
+ */
+static const char* pressure_find(const char* p, const char* end, const char* key) {
+    size_t len = strlen(key);
+
+    for (; p + len <= end; p++) {
+        if (0 == memcmp(p, key, len)) {
+            return p + len;
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t pressure_read_value(int fd, char* buf, size_t size) {
+    int64_t value;
+
+    if (fd < 0 || 0 >= procfs_pread(fd, buf, size) || NULL == procfs_parse_dec(buf, buf + strlen(buf), &value)) {
+        return PRESSURE_UNAVAILABLE;
+    }
+
+    return (uint32_t) value;
+}
+
+/**
+ * some avg10=0.12 avg60=0.05 avg300=0.01 total=123456
+ * full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ */
+static void pressure_sample_psi(pressure_sampler_t* thiz, int resource, char* buf, size_t size, pressure_sample_t* sample) {
+    const char* full;
+    const char* end;
+    const char* p;
+    int64_t total;
+
+    sample->some_avg10[resource] = sample->full_avg10[resource] = PRESSURE_UNAVAILABLE;
+    sample->some_delta_us[resource] = sample->full_delta_us[resource] = PRESSURE_UNAVAILABLE;
+
+    if (thiz->psi[resource] < 0 || 0 >= procfs_pread(thiz->psi[resource], buf, size)) {
+        return;
+    }
+
+    end = buf + strlen(buf);
+    full = pressure_find(buf, end, "full ");
+
+    if (NULL != (p = pressure_find(buf, end, "some avg10="))) {
+        pressure_parse_fixed(p, end, &sample->some_avg10[resource]);
+    }
+    if (NULL != (p = pressure_find(buf, end, "total=")) && NULL != procfs_parse_dec(p, end, &total)) {
+        sample->some_delta_us[resource] = thiz->primed ? (uint32_t) ((uint64_t) total - thiz->some_total[resource]) : 0;
+        thiz->some_total[resource] = (uint64_t) total;
+    }
+
+    // cpu has no full line before Linux 5.13
+    if (NULL == full) {
+        return;
+    }
+
+    if (NULL != (p = pressure_find(full, end, "avg10="))) {
+        pressure_parse_fixed(p, end, &sample->full_avg10[resource]);
+    }
+    if (NULL != (p = pressure_find(full, end, "total=")) && NULL != procfs_parse_dec(p, end, &total)) {
+        sample->full_delta_us[resource] = thiz->primed ? (uint32_t) ((uint64_t) total - thiz->full_total[resource]) : 0;
+        thiz->full_total[resource] = (uint64_t) total;
+    }
+}
+
+static uint32_t pressure_meminfo_value(const char* buf, const char* end, const char* key) {
+    const char* p;
+    int64_t value;
+
+    if (NULL == (p = pressure_find(buf, end, key))) {
+        return PRESSURE_UNAVAILABLE;
+    }
+
+    for (; p < end && ' ' == *p; p++) {
+        continue;
+    }
+
+    return NULL != procfs_parse_dec(p, end, &value) ? (uint32_t) value : PRESSURE_UNAVAILABLE;
+}
+
+static void pressure_sample_meminfo(pressure_sampler_t* thiz, char* buf, size_t size, pressure_sample_t* sample) {
+    const char* end;
+
+    sample->mem_available_kb = sample->mem_free_kb = sample->swap_free_kb = PRESSURE_UNAVAILABLE;
+
+    if (thiz->meminfo < 0 || 0 >= procfs_pread(thiz->meminfo, buf, size)) {
+        return;
+    }
+
+    end = buf + strlen(buf);
+    sample->mem_available_kb = pressure_meminfo_value(buf, end, "\nMemAvailable:");
+    sample->mem_free_kb = pressure_meminfo_value(buf, end, "\nMemFree:");
+    sample->swap_free_kb = pressure_meminfo_value(buf, end, "\nSwapFree:");
+}
+
+/**
+ * 0.52 0.58 0.59 2/1234 5678
+ */
+static void pressure_sample_loadavg(pressure_sampler_t* thiz, char* buf, size_t size, pressure_sample_t* sample) {
+    const char* end;
+    const char* p;
+    int64_t value;
+
+    sample->load1 = sample->runnable = sample->threads = PRESSURE_UNAVAILABLE;
+
+    if (thiz->loadavg < 0 || 0 >= procfs_pread(thiz->loadavg, buf, size)) {
+        return;
+    }
+
+    end = buf + strlen(buf);
+    pressure_parse_fixed(buf, end, &sample->load1);
+
+    if (NULL != (p = memchr(buf, '/', (size_t) (end - buf)))) {
+        for (; p > buf && ' ' != p[-1]; p--) {
+            continue;
+        }
+        if (NULL != (p = procfs_parse_dec(p, end, &value)) && p < end) {
+            sample->runnable = (uint32_t) value;
+            if (NULL != procfs_parse_dec(p + 1, end, &value)) {
+                sample->threads = (uint32_t) value;
+            }
+        }
+    }
+}
+
+static void pressure_sample(pressure_sampler_t* thiz, pressure_sample_t* sample) {
+    char buf[4096];
+
+    sample->time_ms = pressure_now_ms();
+
+    for (int i = 0; i < PRESSURE_RESOURCES; i++) {
+        pressure_sample_psi(thiz, i, buf, sizeof(buf), sample);
+    }
+    thiz->primed = 1;
+
+    pressure_sample_meminfo(thiz, buf, sizeof(buf), sample);
+    pressure_sample_loadavg(thiz, buf, sizeof(buf), sample);
+
+    for (int i = 0; i < PRESSURE_MAX_CPUS; i++) {
+        sample->cpufreq_khz[i] = pressure_read_value(thiz->cpufreq[i], buf, sizeof(buf));
+    }
+    for (int i = 0; i < PRESSURE_MAX_ZONES; i++) {
+        sample->thermal_mc[i] = (int32_t) pressure_read_value(thiz->thermal[i], buf, sizeof(buf));
+    }
+}
+
+/**
+ * Publish the sample, the readers retry or skip the slot being written
+ */
+static void pressure_publish(const pressure_sample_t* sample) {
+    uint_fast64_t head = atomic_load_explicit(&pressure_head, memory_order_relaxed);
+    pressure_slot_t* slot = &pressure_ring[head % PRESSURE_RING_SIZE];
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->sample, sample, sizeof(*sample));
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&pressure_head, head + 1, memory_order_release);
+}
+
+static void* pressure_run(void* args) {
+    pressure_sampler_t* thiz = args;
+    pressure_sample_t sample;
+    struct timespec next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (;;) {
+        memset(&sample, 0, sizeof(sample));
+        pressure_sample(thiz, &sample);
+        pressure_publish(&sample);
+
+        next.tv_sec += thiz->interval_ms / 1000;
+        next.tv_nsec += (long) (thiz->interval_ms % 1000) * 1000000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)) {
+            continue;
+        }
+    }
+
+    return NULL;
+}
+
+int pressure_start(uint32_t interval_ms) {
+    pressure_sampler_t* thiz = &pressure_sampler;
+    pthread_attr_t attr;
+    pthread_t thread;
+    char path[128];
+    int rc = 0;
+
+    pthread_mutex_lock(&pressure_mutex);
+
+    if (pressure_started) {
+        goto done;
+    }
+
+    thiz->interval_ms = interval_ms > 0 ? interval_ms : 1000;
+
+    // PSI is available since Linux 4.20, and might be backported
+    for (int i = 0; i < PRESSURE_RESOURCES; i++) {
+        thiz->psi[i] = pressure_open(pressure_psi_paths[i]);
+    }
+    thiz->meminfo = pressure_open("/proc/meminfo");
+    thiz->loadavg = pressure_open("/proc/loadavg");
+
+    // the nodes might be denied by SELinux
+    for (int i = 0; i < PRESSURE_MAX_CPUS; i++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
+        thiz->cpufreq[i] = pressure_open(path);
+    }
+    for (int i = 0; i < PRESSURE_MAX_ZONES; i++) {
+        snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/temp", i);
+        thiz->thermal[i] = pressure_open(path);
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, pressure_run, thiz);
+    pthread_attr_destroy(&attr);
+
+    if (0 != rc) {
+        LOGD("failed to start pressure sampler: %s", strerror(rc));
+        goto done;
+    }
+
+    pthread_setname_np(thread, "PressureSampler");
+    pressure_started = 1;
+
+done:
+    pthread_mutex_unlock(&pressure_mutex);
+    return rc;
+}
+
+size_t pressure_get_samples(pressure_sample_t* samples, size_t count, uint32_t seconds) {
+    uint_fast64_t head = atomic_load_explicit(&pressure_head, memory_order_acquire);
+    uint64_t since = pressure_now_ms() - (uint64_t) seconds * 1000;
+    size_t n = 0;
+
+    // walk backwards from the latest, then reverse
+    for (uint_fast64_t i = head; i > 0 && n < count && head - i < PRESSURE_RING_SIZE - 1; i--) {
+        pressure_slot_t* slot = &pressure_ring[(i - 1) % PRESSURE_RING_SIZE];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if (seq & 1) {
+            break;
+        }
+
+        memcpy(&samples[n], &slot->sample, sizeof(samples[n]));
+        atomic_thread_fence(memory_order_acquire);
+
+        // overwritten while copying
+        if (seq != atomic_load_explicit(&slot->seq, memory_order_relaxed) || samples[n].time_ms < since) {
+            break;
+        }
+        n++;
+    }
+
+    for (size_t i = 0; i < n / 2; i++) {
+        pressure_sample_t tmp = samples[i];
+        samples[i] = samples[n - 1 - i];
+        samples[n - 1 - i] = tmp;
+    }
+
+    return n;
+}
+
+/**
+ * Append to the text, returns non-zero if it's full
+ */
+__attribute__((format(printf, 3, 4)))
+static int pressure_printf(char** p, const char* end, const char* fmt, ...) {
+    size_t avail = (size_t) (end - *p);
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(*p, avail + 1, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || (size_t) n > avail) {
+        **p = '\0';
+        return -1;
+    }
+
+    *p += n;
+    return 0;
+}
+
+static int pressure_format_psi(char** p, const char* end, const pressure_sample_t* sample, int resource, const char* name) {
+    if (PRESSURE_UNAVAILABLE == sample->some_avg10[resource]) {
+        return 0;
+    }
+
+    if (0 != pressure_printf(p, end, " %s=%" PRIu32 ".%02" PRIu32 "(+%" PRIu32 "us)", name,
+            sample->some_avg10[resource] / 100, sample->some_avg10[resource] % 100, sample->some_delta_us[resource])) {
+        return -1;
+    }
+
+    if (PRESSURE_UNAVAILABLE == sample->full_avg10[resource]) {
+        return 0;
+    }
+
+    return pressure_printf(p, end, "/%" PRIu32 ".%02" PRIu32 "(+%" PRIu32 "us)",
+            sample->full_avg10[resource] / 100, sample->full_avg10[resource] % 100, sample->full_delta_us[resource]);
+}
+
+static int pressure_format(char** p, const char* end, const pressure_sample_t* sample, uint64_t now) {
+    if (0 != pressure_printf(p, end, "  t=-%" PRIu64 ".%03" PRIu64 "s", (now - sample->time_ms) / 1000, (now - sample->time_ms) % 1000)
+            || 0 != pressure_format_psi(p, end, sample, PRESSURE_CPU, "cpu")
+            || 0 != pressure_format_psi(p, end, sample, PRESSURE_MEMORY, "mem")
+            || 0 != pressure_format_psi(p, end, sample, PRESSURE_IO, "io")) {
+        return -1;
+    }
+
+    if (PRESSURE_UNAVAILABLE != sample->mem_available_kb
+            && 0 != pressure_printf(p, end, " avail=%" PRIu32 "kB free=%" PRIu32 "kB swap_free=%" PRIu32 "kB",
+                    sample->mem_available_kb, sample->mem_free_kb, sample->swap_free_kb)) {
+        return -1;
+    }
+
+    if (PRESSURE_UNAVAILABLE != sample->load1
+            && 0 != pressure_printf(p, end, " load=%" PRIu32 ".%02" PRIu32 " runnable=%" PRIu32 "/%" PRIu32,
+                    sample->load1 / 100, sample->load1 % 100, sample->runnable, sample->threads)) {
+        return -1;
+    }
+
+    for (int i = 0; i < PRESSURE_MAX_CPUS; i++) {
+        if (PRESSURE_UNAVAILABLE != sample->cpufreq_khz[i]
+                && 0 != pressure_printf(p, end, " cpu%d=%" PRIu32 "MHz", i, sample->cpufreq_khz[i] / 1000)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < PRESSURE_MAX_ZONES; i++) {
+        if (PRESSURE_UNAVAILABLE != (uint32_t) sample->thermal_mc[i]
+                && 0 != pressure_printf(p, end, " tz%d=%" PRId32 "mC", i, sample->thermal_mc[i])) {
+            return -1;
+        }
+    }
+
+    return pressure_printf(p, end, "\n");
+}
+
+size_t pressure_dump(char* buf, size_t size, uint32_t seconds) {
+    static pressure_sample_t samples[PRESSURE_RING_SIZE];
+    uint64_t now = pressure_now_ms();
+    char* end = buf + size - 1;
+    char* p = buf;
+    char* mark;
+    size_t n;
+
+    if (0 == size) {
+        return 0;
+    }
+
+    *buf = '\0';
+    n = pressure_get_samples(samples, ARRAY_SIZE(samples), seconds);
+
+    for (size_t i = 0; i < n; i++) {
+        mark = p;
+        if (0 != pressure_format(&p, end, &samples[i], now)) {
+            // drop the partial line
+            p = mark;
+            *p = '\0';
+            break;
+        }
+    }
+
+    return (size_t) (p - buf);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
@@ -0,0 +1,78 @@
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PRESSURE_MAX_CPUS 8
+
+#define PRESSURE_MAX_ZONES 8
+
+enum {
+    PRESSURE_CPU,
+    PRESSURE_MEMORY,
+    PRESSURE_IO,
+    PRESSURE_RESOURCES,
+};
+
+/**
+ * A sample of the system pressure, the monotonic counters are delta encoded against the previous sample,
+ * and the unavailable values are <code>UINT32_MAX</code>
+ */
+typedef struct pressure_sample {
+    /* CLOCK_MONOTONIC */
+    uint64_t time_ms;
+
+    /* avg10 of /proc/pressure/{cpu,memory,io} in 1/100 percent */
+    uint32_t some_avg10[PRESSURE_RESOURCES];
+    uint32_t full_avg10[PRESSURE_RESOURCES];
+
+    /* the stall time in microseconds since the previous sample */
+    uint32_t some_delta_us[PRESSURE_RESOURCES];
+    uint32_t full_delta_us[PRESSURE_RESOURCES];
+
+    /* /proc/meminfo */
+    uint32_t mem_available_kb;
+    uint32_t mem_free_kb;
+    uint32_t swap_free_kb;
+
+    /* /proc/loadavg, the load is in 1/100 */
+    uint32_t load1;
+    uint32_t runnable;
+    uint32_t threads;
+
+    uint32_t cpufreq_khz[PRESSURE_MAX_CPUS];
+    int32_t thermal_mc[PRESSURE_MAX_ZONES];
+} pressure_sample_t;
+
+/**
+ * Start sampling the system pressure in background every <code>interval_ms</code> into a fixed size ring,
+ * the files are kept open, and nothing is allocated after start.
+ *
+ * @return 0 if started or it's already started
+ */
+int pressure_start(uint32_t interval_ms);
+
+/**
+ * Copy the latest samples no earlier than <code>seconds</code> ago, without blocking the sampler
+ *
+ * @return the number of samples copied, in the order of time
+ */
+size_t pressure_get_samples(pressure_sample_t* samples, size_t count, uint32_t seconds);
+
+/**
+ * Format the latest samples no earlier than <code>seconds</code> ago into <code>buf</code>
+ *
+ * @return the length of text without the trailing <code>'\0'</code>
+ */
+size_t pressure_dump(char* buf, size_t size, uint32_t seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRESSURE_H */
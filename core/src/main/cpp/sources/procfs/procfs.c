@@ -1,24 +1,11 @@
-#include <ctype.h>
-#include <errno.h>
-#include <inttypes.h>
-#include <stdlib.h>
+#include <dlfcn.h>
+#include <pthread.h>
 #include <string.h>
-#include <unistd.h>
-#include <dirent.h>
-#include <fcntl.h>
-#include <linux/sched.h>
-#include <sys/param.h>
 
-#include "defs.h"
 #include "log.h"
+#include "maps.h"
+#include "parser.h"
 #include "procfs.h"
-#include "text.h"
-
-#ifndef TASK_COMM_LEN
-#define TASK_COMM_LEN 24
-#endif
-
-#define MAPS_FMT "%"SCNxPTR"-%*"SCNxPTR" %*4s %"SCNxPTR" %*x:%*x %*d%n"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wgnu-statement-expression"
@@ -28,114 +15,70 @@ extern "C" {
 #endif
 
 const char* procfs_get_task_comm(pid_t tid, char* buf, size_t size) {
-    if (NULL == buf) {
+    if (NULL == buf || 0 > procfs_read_comm(tid, buf, size)) {
         return NULL;
     }
 
-    char path[64];
-    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
-    char comm[TASK_COMM_LEN];
-    ssize_t len = file_read_fully(path, comm, sizeof(comm));
-    if (len < 0) {
-        return NULL;
-    }
-
-    strncpy(buf, comm, MIN((size_t) len, size));
-    return strrtrim(buf);
+    return buf;
 }
 
-pid_t procfs_get_tid(int (*select)(pid_t)) {
-    DIR *dir;
-    char task[128];
-    pid_t tid = -1;
-    struct dirent *ent;
-
-    snprintf(task, sizeof(task), "/proc/%d/task", getpid());
-    if (NULL == (dir = opendir(task))) {
-        goto error;
-    }
-
-    while (NULL != (ent = readdir(dir))) {
-        for (char* c = ent->d_name; *c != '\0'; c++) {
-            if (!isdigit(*c)) goto outer;
-        }
+static procfs_maps_t* procfs_maps = NULL;
 
-        errno = 0;
-        if (0 >= (tid = (pid_t) strtol(ent->d_name, NULL, 10)) || 0 != errno) {
-            continue;
-        }
+static pthread_mutex_t procfs_maps_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-        if (0 == select(tid)) {
-            break;
+/**
+ * The cached addresses are still valid if the loader has the libraries there, which is told without
+ * reading /proc/self/maps, the ones not loaded by the loader are never taken as valid
+ */
+static int procfs_is_loaded_at(const char** pathnames, const uintptr_t* addresses, size_t count) {
+    Dl_info info;
+
+    for (size_t i = 0; i < count; i++) {
+        if (0 == dladdr((void*) addresses[i], &info)
+                || addresses[i] != (uintptr_t) info.dli_fbase
+                || NULL == info.dli_fname
+                || 0 != strcmp(pathnames[i], info.dli_fname)) {
+            return 0;
         }
-
-        tid = -1;
-        outer: continue;
     }
 
-    closedir(dir);
-
-error:
-    return tid;
+    return 1;
 }
 
-const char* procfs_get_thread_status(pid_t tid, char* line, size_t len, int (*select)(const char*)) {
-    char status[128];
-    snprintf(status, sizeof(status), "/proc/%d/status", tid);
+/**
+ * Locate shared libraries from the index of /proc/self/maps, which is refreshed only if any of them is missed,
+ * or isn't loaded there anymore, as a library might be unmapped and mapped elsewhere since
+ */
+size_t procfs_get_map_addresses(const char** pathnames, uintptr_t* addresses, size_t count) {
+    size_t unmapped = count;
 
-    FILE* fp = NULL;
-    if (NULL == (fp = fopen(status, "r"))) {
-        return NULL;
+    pthread_mutex_lock(&procfs_maps_mutex);
+
+    // the index is parsed again only if the mappings changed
+    if (NULL == procfs_maps) {
+        procfs_maps = procfs_maps_open();
+    } else if ((0 != procfs_maps_get_addresses(procfs_maps, pathnames, addresses, count) || !procfs_is_loaded_at(pathnames, addresses, count))
+            && 0 > procfs_maps_refresh(procfs_maps)) {
+        procfs_maps_close(&procfs_maps);
     }
 
-    while (fgets(line, (int) len, fp)) {
-        if (0 == select(line)) {
-            fclose(fp);
-            return line;
-        }
+    if (NULL != procfs_maps) {
+        unmapped = procfs_maps_get_addresses(procfs_maps, pathnames, addresses, count);
+    } else {
+        memset(addresses, 0, count * sizeof(uintptr_t));
     }
 
-    return NULL;
+    pthread_mutex_unlock(&procfs_maps_mutex);
+    return unmapped;
 }
 
-/**
- * Locate shared library from /proc/self/maps
- *
- * <pre>
- * address               perm offset   dev   inode                          pathname
- * 7340f11000-7340ff3000 r-xp 00000000 fd:00 1951                           /system/lib64/libc++.so
- * 7340ff4000-7340ffc000 r--p 000e2000 fd:00 1951                           /system/lib64/libc++.so
- * 7340ffc000-7340ffd000 rw-p 000ea000 fd:00 1951                           /system/lib64/libc++.so
- * </pre>
- */
 int procfs_get_map_address(const char* pathname, uintptr_t* address) {
-    FILE* maps = NULL;
-    if (NULL == (maps = fopen("/proc/self/maps", "r"))) {
-        LOGD("cannot open /proc/self/maps : %s", strerror(errno));
-        return errno;
+    if (0 != procfs_get_map_addresses(&pathname, address, 1)) {
+        LOGD("%s not mapped", pathname);
+        return -1;
     }
 
-    char line[PATH_MAX];
-    uintptr_t offset;
-    int pos;
-    char* str;
-    int found = 0;
-
-    while (fgets(line, sizeof(line), maps)) {
-        if (2 != sscanf(line, MAPS_FMT, address, &offset, &pos) || 0 != offset) {
-            continue;
-        }
-        str = strtrim(line + pos);
-        if (0 == strcmp(str, pathname)) {
-            LOGD("%s", line);
-            found = 1;
-            break;
-        }
-    }
-
-    fclose(maps);
-    return !found;
-
+    return 0;
 }
 
 #ifdef __cplusplus
@@ -10,14 +10,18 @@
 extern "C" {
 #endif
 
-pid_t procfs_get_tid(int (*select)(pid_t));
-
-const char* procfs_get_thread_status(pid_t tid, char* line, size_t len, int (*select)(const char*));
-
 const char* procfs_get_task_comm(pid_t tid, char* buf, size_t size);
 
 int procfs_get_map_address(const char* path, uintptr_t* address);
 
+/**
+ * Lookup the base addresses of <code>pathnames</code> in one pass over the mappings
+ *
+ * @param addresses the base addresses associated with <code>pathnames</code>, 0 for unmapped ones
+ * @return the number of unmapped <code>pathnames</code>
+ */
+size_t procfs_get_map_addresses(const char** pathnames, uintptr_t* addresses, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
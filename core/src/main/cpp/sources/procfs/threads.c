@@ -0,0 +1,368 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+
+#include "batch.h"
+#include "defs.h"
+#include "log.h"
+#include "parser.h"
+#include "threads.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wgnu-statement-expression"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DIRENT_BUFFER_SIZE 4096
+
+#define THREAD_STACK_SIZE 4096
+
+#define THREAD_FOOTER_SIZE 64
+
+#define THREAD_BATCH_SIZE 32
+
+/**
+ * The layout of <code>getdents64</code>, which isn't always exposed by libc
+ */
+typedef struct procfs_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} procfs_dirent64_t;
+
+typedef struct procfs_snapshot {
+    procfs_thread_t* threads;
+    size_t count;
+    size_t n;
+} procfs_snapshot_t;
+
+enum {
+    THREAD_FILE_STAT,
+    THREAD_FILE_WCHAN,
+    THREAD_FILE_SCHEDSTAT,
+    THREAD_FILE_STACK,
+    THREAD_FILE_COUNT,
+};
+
+static const struct {
+    const char* name;
+    size_t size;
+} procfs_thread_files[THREAD_FILE_COUNT] = {
+    [THREAD_FILE_STAT]      = { "stat", 1024 },
+    [THREAD_FILE_WCHAN]     = { "wchan", 64 },
+    [THREAD_FILE_SCHEDSTAT] = { "schedstat", 64 },
+    [THREAD_FILE_STACK]     = { "stack", THREAD_STACK_SIZE },
+};
+
+typedef struct procfs_dump {
+    char* p;
+    char* end;
+    uint64_t deadline;
+    size_t skipped;
+    int full;
+
+    /* the files of threads in a round are read at once */
+    io_batch_t* batch;
+    size_t nthreads;
+    struct {
+        pid_t tid;
+        ssize_t files[THREAD_FILE_COUNT];
+    } threads[THREAD_BATCH_SIZE];
+} procfs_dump_t;
+
+static io_batch_t* procfs_dump_batch = NULL;
+
+int procfs_foreach_thread(int (*visit)(int dirfd, pid_t tid, void* data), void* data) {
+    uint8_t buf[DIRENT_BUFFER_SIZE] __attribute__((aligned(8)));
+    const procfs_dirent64_t* ent;
+    const char* end;
+    int64_t tid;
+    long n;
+    int stop = 0;
+    int fd;
+
+    if (0 > (fd = TEMP_FAILURE_RETRY(open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC)))) {
+        return -1;
+    }
+
+    while (0 == stop) {
+        if (0 >= (n = TEMP_FAILURE_RETRY(syscall(SYS_getdents64, fd, buf, sizeof(buf))))) {
+            stop = n < 0 ? -1 : 0;
+            break;
+        }
+
+        for (long pos = 0; 0 == stop && pos < n; pos += ent->d_reclen) {
+            ent = (const void*) (buf + pos);
+            end = ent->d_name + strlen(ent->d_name);
+
+            // skip . and ..
+            if (end != procfs_parse_dec(ent->d_name, end, &tid) || tid <= 0) {
+                continue;
+            }
+
+            stop = visit(fd, (pid_t) tid, data);
+        }
+    }
+
+    close(fd);
+    return stop;
+}
+
+static int procfs_snapshot_thread(int dirfd, pid_t tid, void* data) {
+    procfs_snapshot_t* snapshot = data;
+    procfs_thread_t* thread;
+    procfs_status_t status;
+    char path[32];
+    char buf[2048];
+    ssize_t n;
+
+    if (snapshot->n >= snapshot->count) {
+        snapshot->n++;
+        return 0;
+    }
+
+    // the thread might have exited
+    if (NULL == procfs_format_task_path(path, sizeof(path), tid, "status")
+            || 0 > (n = procfs_read_at(dirfd, path, buf, sizeof(buf)))
+            || 0 != procfs_parse_status(buf, (size_t) n, &status)) {
+        return 0;
+    }
+
+    thread = &snapshot->threads[snapshot->n++];
+    thread->tid = tid;
+    thread->state = status.state;
+    thread->sig_blk = status.sig_blk;
+    memcpy(thread->comm, status.name, sizeof(thread->comm));
+    return 0;
+}
+
+ssize_t procfs_snapshot_threads(procfs_thread_t* threads, size_t count) {
+    procfs_snapshot_t snapshot = { .threads = threads, .count = count };
+
+    if (0 != procfs_foreach_thread(procfs_snapshot_thread, &snapshot)) {
+        return -1;
+    }
+
+    return (ssize_t) snapshot.n;
+}
+
+static uint64_t procfs_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Append to the table, returns non-zero if it's full
+ */
+__attribute__((format(printf, 2, 3)))
+static int procfs_dump_printf(procfs_dump_t* dump, const char* fmt, ...) {
+    size_t avail = (size_t) (dump->end - dump->p);
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(dump->p, avail + 1, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || (size_t) n > avail) {
+        return -1;
+    }
+
+    dump->p += n;
+    return 0;
+}
+
+/**
+ * Get the file of thread read in the batch, the trailing line feeds are stripped
+ */
+static ssize_t procfs_dump_get(procfs_dump_t* dump, size_t thread, int file, char** content) {
+    ssize_t index = dump->threads[thread].files[file];
+    ssize_t n;
+
+    if (0 > index || 0 > (n = io_batch_get(dump->batch, (size_t) index, content))) {
+        return -1;
+    }
+
+    while (n > 0 && '\n' == (*content)[n - 1]) {
+        (*content)[--n] = '\0';
+    }
+
+    return n;
+}
+
+static void procfs_dump_format(procfs_dump_t* dump, size_t thread) {
+    procfs_stat_t stat;
+    pid_t tid = dump->threads[thread].tid;
+    char* mark = dump->p;
+    char* content;
+    const char* wchan = "?";
+    int64_t run_delay = -1;
+    const char* end;
+    const char* eol;
+    const char* p;
+    ssize_t n;
+
+    if (dump->full) {
+        dump->skipped++;
+        return;
+    }
+
+    // the thread might have exited
+    if (0 > (n = procfs_dump_get(dump, thread, THREAD_FILE_STAT, &content)) || 0 != procfs_parse_stat(content, (size_t) n, &stat)) {
+        return;
+    }
+
+    if (0 < procfs_dump_get(dump, thread, THREAD_FILE_WCHAN, &content)) {
+        wchan = content;
+    }
+
+    // schedstat: [time on cpu] [time waiting on runqueue] [timeslices]
+    if (0 < (n = procfs_dump_get(dump, thread, THREAD_FILE_SCHEDSTAT, &content))) {
+        end = content + n;
+        if (NULL == (p = procfs_parse_dec(content, end, &run_delay)) || p >= end || NULL == procfs_parse_dec(p + 1, end, &run_delay)) {
+            run_delay = -1;
+        }
+    }
+
+    if (0 != procfs_dump_printf(dump, "  tid=%-6d %c utm=%-6" PRIu64 " stm=%-6" PRIu64 " majflt=%-4" PRIu64 " run_delay=%-12" PRId64 " wchan=%-24s \"%s\"\n",
+            tid, stat.state, stat.utime, stat.stime, stat.majflt, run_delay, wchan, stat.comm)) {
+        // drop the partial line and count the rest only
+        dump->p = mark;
+        *mark = '\0';
+        dump->skipped++;
+        dump->full = 1;
+        return;
+    }
+
+    // usually readable with CAP_SYS_ADMIN only, and dropped if there's no room
+    mark = dump->p;
+    if (0 < (n = procfs_dump_get(dump, thread, THREAD_FILE_STACK, &content))) {
+        end = content + n;
+        for (p = content; p < end; p = eol + 1) {
+            if (NULL == (eol = memchr(p, '\n', (size_t) (end - p)))) {
+                eol = end;
+            }
+            if (0 != procfs_dump_printf(dump, "      %.*s\n", (int) (eol - p), p)) {
+                dump->p = mark;
+                *mark = '\0';
+                dump->full = 1;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Read the files of threads in this round at once, then format them
+ */
+static void procfs_dump_flush(procfs_dump_t* dump) {
+    io_batch_submit(dump->batch);
+
+    for (size_t i = 0; i < dump->nthreads; i++) {
+        procfs_dump_format(dump, i);
+    }
+
+    io_batch_reset(dump->batch);
+    dump->nthreads = 0;
+}
+
+static int procfs_dump_thread(int dirfd, pid_t tid, void* data) {
+    procfs_dump_t* dump = data;
+    char path[32];
+    int fd;
+
+    if (dump->full || procfs_now() >= dump->deadline) {
+        dump->skipped++;
+        return 0;
+    }
+
+    dump->threads[dump->nthreads].tid = tid;
+    for (int i = 0; i < THREAD_FILE_COUNT; i++) {
+        dump->threads[dump->nthreads].files[i] = -1;
+
+        // the thread might have exited
+        if (NULL == procfs_format_task_path(path, sizeof(path), tid, procfs_thread_files[i].name)
+                || 0 > (fd = TEMP_FAILURE_RETRY(openat(dirfd, path, O_RDONLY | O_CLOEXEC)))) {
+            continue;
+        }
+
+        if (0 > (dump->threads[dump->nthreads].files[i] = io_batch_add(dump->batch, fd, procfs_thread_files[i].size))) {
+            close(fd);
+        }
+    }
+
+    if (++dump->nthreads == THREAD_BATCH_SIZE) {
+        procfs_dump_flush(dump);
+    }
+
+    return 0;
+}
+
+int procfs_dump_threads_init(void) {
+    size_t arena_size = 0;
+
+    if (NULL != procfs_dump_batch) {
+        return 0;
+    }
+
+    for (int i = 0; i < THREAD_FILE_COUNT; i++) {
+        arena_size += procfs_thread_files[i].size;
+    }
+
+    procfs_dump_batch = io_batch_create(THREAD_BATCH_SIZE * THREAD_FILE_COUNT, THREAD_BATCH_SIZE * arena_size);
+    if (NULL == procfs_dump_batch) {
+        return -1;
+    }
+
+    LOGD("dump threads through %s", io_batch_is_uring(procfs_dump_batch) ? "io_uring" : "preadv");
+    return 0;
+}
+
+size_t procfs_dump_threads(char* buf, size_t size, uint64_t budget_ns) {
+    static procfs_dump_t dump;
+
+    if (size <= THREAD_FOOTER_SIZE || 0 != procfs_dump_threads_init()) {
+        return 0;
+    }
+
+    // reserve the room of footer
+    dump.p = buf;
+    dump.end = buf + size - 1 - THREAD_FOOTER_SIZE;
+    dump.deadline = procfs_now() + budget_ns;
+    dump.skipped = 0;
+    dump.full = 0;
+    dump.batch = procfs_dump_batch;
+    dump.nthreads = 0;
+    *buf = '\0';
+
+    procfs_foreach_thread(procfs_dump_thread, &dump);
+    if (dump.nthreads > 0) {
+        procfs_dump_flush(&dump);
+    }
+
+    if (dump.skipped > 0) {
+        dump.end = buf + size - 1;
+        procfs_dump_printf(&dump, "  ... %zu threads skipped\n", dump.skipped);
+    }
+
+    return (size_t) (dump.p - buf);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma clang diagnostic pop
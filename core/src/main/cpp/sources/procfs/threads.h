@@ -0,0 +1,67 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A thread of the current process
+ */
+typedef struct procfs_thread {
+    pid_t tid;
+    char state;
+    char comm[16];
+    uint64_t sig_blk;
+} procfs_thread_t;
+
+/**
+ * Visit the threads of the current process with a raw <code>getdents64</code> over <code>/proc/self/task</code>
+ *
+ * @param visit the visitor, the files of thread could be opened by <code>openat(dirfd, "[tid]/[name]")</code>,
+ *        returns non-zero to stop
+ * @param data the data passed to <code>visit</code>
+ * @return the value returned by <code>visit</code> if stopped, 0 if all visited, otherwise <code>-1</code>
+ */
+int procfs_foreach_thread(int (*visit)(int dirfd, pid_t tid, void* data), void* data);
+
+/**
+ * Take a snapshot of the threads, each of them costs one read of its <code>status</code>
+ *
+ * @param threads the threads
+ * @param count the capacity of <code>threads</code>
+ * @return the number of threads, which might be greater than <code>count</code>, or <code>-1</code> if failed
+ */
+ssize_t procfs_snapshot_threads(procfs_thread_t* threads, size_t count);
+
+/**
+ * Format the kernel state of threads as a table into <code>buf</code>, one line per thread with the run state,
+ * <code>utime</code>, <code>stime</code>, <code>majflt</code>, <code>wchan</code> and the run delay of
+ * <code>schedstat</code>, followed by the kernel stack if it's readable.
+ *
+ * The files of threads are read in batches, the threads left after <code>budget_ns</code> elapsed or
+ * <code>buf</code> filled up are counted only. It isn't reentrant.
+ *
+ * @param buf the preallocated buffer
+ * @param size the size of <code>buf</code>
+ * @param budget_ns the time budget in nanoseconds
+ * @return the length of table without the trailing <code>'\0'</code>
+ */
+size_t procfs_dump_threads(char* buf, size_t size, uint64_t budget_ns);
+
+/**
+ * Preallocate the batch of <code>procfs_dump_threads</code>, which is done on the first dump otherwise
+ *
+ * @return 0 if succeeded
+ */
+int procfs_dump_threads_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THREADS_H */
@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TOKENIZER_NEON 1
+#elif defined(__x86_64__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define TOKENIZER_SSE2 1
+#endif
+
+#include "tokenizer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(TOKENIZER_NEON)
+
+/**
+ * The mask of matched bytes, 4 bits per byte
+ */
+static inline uint64_t procfs_match_mask(uint8x16_t eq) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+const char* procfs_find_any(const char* p, const char* end, char a, char b) {
+    uint8x16_t va = vdupq_n_u8((uint8_t) a);
+    uint8x16_t vb = vdupq_n_u8((uint8_t) b);
+    uint64_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*) p);
+        if (0 != (mask = procfs_match_mask(vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb))))) {
+            return p + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    for (; p < end; p++) {
+        if (a == *p || b == *p) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+size_t procfs_count(const char* p, const char* end, char c) {
+    uint8x16_t vc = vdupq_n_u8((uint8_t) c);
+    uint8x16_t one = vdupq_n_u8(1);
+    size_t n = 0;
+
+    for (; end - p >= 16; p += 16) {
+        n += vaddvq_u8(vandq_u8(vceqq_u8(vld1q_u8((const uint8_t*) p), vc), one));
+    }
+
+    for (; p < end; p++) {
+        n += c == *p;
+    }
+
+    return n;
+}
+
+#elif defined(TOKENIZER_SSE2)
+
+const char* procfs_find_any(const char* p, const char* end, char a, char b) {
+    __m128i va = _mm_set1_epi8(a);
+    __m128i vb = _mm_set1_epi8(b);
+    int mask;
+
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (const void*) p);
+        if (0 != (mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb))))) {
+            return p + __builtin_ctz((unsigned) mask);
+        }
+    }
+
+    for (; p < end; p++) {
+        if (a == *p || b == *p) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+size_t procfs_count(const char* p, const char* end, char c) {
+    __m128i vc = _mm_set1_epi8(c);
+    size_t n = 0;
+
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (const void*) p);
+        n += (size_t) __builtin_popcount((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, vc)));
+    }
+
+    for (; p < end; p++) {
+        n += c == *p;
+    }
+
+    return n;
+}
+
+#else
+
+const char* procfs_find_any(const char* p, const char* end, char a, char b) {
+    for (; p < end; p++) {
+        if (a == *p || b == *p) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+size_t procfs_count(const char* p, const char* end, char c) {
+    size_t n = 0;
+
+    for (; p < end; p++) {
+        n += c == *p;
+    }
+
+    return n;
+}
+
+#endif
+
+const char* procfs_find(const char* p, const char* end, char c) {
+    return procfs_find_any(p, end, c, c);
+}
+
+void procfs_tokenizer_init(procfs_tokenizer_t* thiz, const char* buf, size_t len) {
+    thiz->p = buf;
+    thiz->end = buf + len;
+}
+
+int procfs_tokenizer_next_line(procfs_tokenizer_t* thiz, procfs_token_t* line) {
+    const char* eol;
+
+    if (thiz->p >= thiz->end) {
+        return 0;
+    }
+
+    if (NULL == (eol = procfs_find(thiz->p, thiz->end, '\n'))) {
+        eol = thiz->end;
+    }
+
+    line->data = thiz->p;
+    line->len = (size_t) (eol - thiz->p);
+    thiz->p = eol + 1;
+    return 1;
+}
+
+int procfs_token_split(const procfs_token_t* line, char sep, procfs_token_t* key, procfs_token_t* value) {
+    const char* end = line->data + line->len;
+    const char* p;
+
+    if (NULL == (p = procfs_find(line->data, end, sep))) {
+        return -1;
+    }
+
+    key->data = line->data;
+    key->len = (size_t) (p - line->data);
+
+    for (p++; p < end && (' ' == *p || '\t' == *p); p++) {
+        continue;
+    }
+
+    value->data = p;
+    value->len = (size_t) (end - p);
+    return 0;
+}
+
+int procfs_token_equals(const procfs_token_t* token, const char* str) {
+    return token->len == strlen(str) && 0 == memcmp(token->data, str, token->len);
+}
+
+#ifdef __cplusplus
+}
+#endif
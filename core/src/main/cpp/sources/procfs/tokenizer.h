@@ -0,0 +1,70 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A zero-copy view of text, which isn't terminated
+ */
+typedef struct procfs_token {
+    const char* data;
+    size_t len;
+} procfs_token_t;
+
+/**
+ * The lines of a buffer, the newlines are found 16 bytes at a time with NEON on arm64 or SSE2 on x86_64
+ */
+typedef struct procfs_tokenizer {
+    const char* p;
+    const char* end;
+} procfs_tokenizer_t;
+
+/**
+ * Find the first <code>a</code> or <code>b</code> in <code>[p, end)</code>
+ *
+ * @return the position found, or <code>NULL</code> if there is none
+ */
+const char* procfs_find_any(const char* p, const char* end, char a, char b);
+
+/**
+ * Find the first <code>c</code> in <code>[p, end)</code>
+ *
+ * @return the position found, or <code>NULL</code> if there is none
+ */
+const char* procfs_find(const char* p, const char* end, char c);
+
+/**
+ * @return the number of <code>c</code> in <code>[p, end)</code>
+ */
+size_t procfs_count(const char* p, const char* end, char c);
+
+void procfs_tokenizer_init(procfs_tokenizer_t* thiz, const char* buf, size_t len);
+
+/**
+ * Yield the next line without the line feed
+ *
+ * @return 1 if yielded, or 0 at the end
+ */
+int procfs_tokenizer_next_line(procfs_tokenizer_t* thiz, procfs_token_t* line);
+
+/**
+ * Split the line like <code>Key:  value</code> at the first <code>sep</code>, the leading blanks of value are skipped
+ *
+ * @return 0 if split
+ */
+int procfs_token_split(const procfs_token_t* line, char sep, procfs_token_t* key, procfs_token_t* value);
+
+/**
+ * @return 1 if the token equals to <code>str</code>
+ */
+int procfs_token_equals(const procfs_token_t* token, const char* str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TOKENIZER_H */
@@ -0,0 +1,128 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file.h"
+
+#define CHECK(cond) do {                                            \
+    if (!(cond)) {                                                  \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);  \
+        return 1;                                                   \
+    }                                                               \
+} while (0)
+
+#define FILE_TEST_SIZE 10000
+
+typedef struct chunks {
+    char data[FILE_TEST_SIZE];
+    size_t size;
+    size_t count;
+} chunks_t;
+
+static int visit_chunk(const char* chunk, size_t size, void* data) {
+    chunks_t* chunks = data;
+
+    if (chunks->size + size > sizeof(chunks->data)) {
+        return 1;
+    }
+
+    memcpy(chunks->data + chunks->size, chunk, size);
+    chunks->size += size;
+    chunks->count++;
+    return 0;
+}
+
+static int write_file(const char* path, const char* data, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+
+    ssize_t n = write(fd, data, size);
+    close(fd);
+    return (ssize_t) size == n ? 0 : -1;
+}
+
+static int equals_file(const char* path, const char* data, size_t size) {
+    static char content[FILE_TEST_SIZE + 1];
+    return (ssize_t) size == file_read_fully(path, content, sizeof(content)) && 0 == memcmp(content, data, size);
+}
+
+int main(void) {
+    static char data[FILE_TEST_SIZE];
+    char dir[] = "/tmp/file_test.XXXXXX";
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    char buf[4096];
+    chunks_t chunks;
+    int pipefd[2];
+    int out;
+    int fd;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char) ('a' + i % 26);
+    }
+
+    CHECK(NULL != mkdtemp(dir));
+    snprintf(src, sizeof(src), "%s/src", dir);
+    snprintf(dst, sizeof(dst), "%s/dst", dir);
+    CHECK(0 == write_file(src, data, sizeof(data)));
+
+    // full chunks except the last one
+    memset(&chunks, 0, sizeof(chunks));
+    CHECK(FILE_TEST_SIZE == file_read_chunks(src, buf, sizeof(buf), SIZE_MAX, visit_chunk, &chunks));
+    CHECK(3 == chunks.count && FILE_TEST_SIZE == chunks.size && 0 == memcmp(chunks.data, data, sizeof(data)));
+
+    // capped
+    memset(&chunks, 0, sizeof(chunks));
+    CHECK(5000 == file_read_chunks(src, buf, sizeof(buf), 5000, visit_chunk, &chunks));
+    CHECK(2 == chunks.count && 5000 == chunks.size && 0 == memcmp(chunks.data, data, 5000));
+
+    // procfs reports size 0
+    memset(&chunks, 0, sizeof(chunks));
+    CHECK(0 < file_read_chunks("/proc/self/status", buf, 64, sizeof(chunks.data), visit_chunk, &chunks));
+    CHECK(0 == strncmp("Name:", chunks.data, 5));
+
+    // file to file from the current offset
+    CHECK(0 <= (out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)));
+    CHECK(FILE_TEST_SIZE == file_copy_to_fd(src, out));
+    close(out);
+    CHECK(equals_file(dst, data, sizeof(data)));
+
+    CHECK(0 <= (fd = open(src, O_RDONLY | O_CLOEXEC)));
+    CHECK(100 == lseek(fd, 100, SEEK_SET));
+    CHECK(0 <= (out = open(dst, O_WRONLY | O_TRUNC | O_CLOEXEC)));
+    CHECK(FILE_TEST_SIZE - 100 == file_copy_fd(fd, out));
+    close(out);
+    close(fd);
+    CHECK(equals_file(dst, data + 100, sizeof(data) - 100));
+
+    // procfs to file, which copy_file_range copies nothing
+    CHECK(0 <= (out = open(dst, O_WRONLY | O_TRUNC | O_CLOEXEC)));
+    CHECK(0 < file_copy_to_fd("/proc/self/status", out));
+    close(out);
+    CHECK(0 < file_read_fully(dst, buf, sizeof(buf)) && 0 == strncmp("Name:", buf, 5));
+
+    // file to pipe
+    CHECK(0 == pipe2(pipefd, O_CLOEXEC));
+    CHECK(0 == write_file(src, data, sizeof(buf)));
+    CHECK((int64_t) sizeof(buf) == file_copy_to_fd(src, pipefd[1]));
+    close(pipefd[1]);
+    memset(&chunks, 0, sizeof(chunks));
+    CHECK((ssize_t) sizeof(buf) == file_read_fd_chunks(pipefd[0], buf, sizeof(buf), SIZE_MAX, visit_chunk, &chunks));
+    close(pipefd[0]);
+    CHECK(sizeof(buf) == chunks.size && 0 == memcmp(chunks.data, data, sizeof(buf)));
+
+    // the target is replaced
+    CHECK(0 == file_move(src, dst));
+    CHECK(0 != access(src, F_OK));
+    CHECK(equals_file(dst, data, sizeof(buf)));
+
+    unlink(dst);
+    rmdir(dir);
+    return 0;
+}
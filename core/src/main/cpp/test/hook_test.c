@@ -0,0 +1,52 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "hook.h"
+
+#define HOOK_TEST_LIB "libhook_test_lib\\.so$"
+
+#define CHECK(cond) do {                                            \
+    if (!(cond)) {                                                  \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);  \
+        return 1;                                                   \
+    }                                                               \
+} while (0)
+
+ssize_t hook_test_say(int fd, const char* s);
+
+static ssize_t (*original_write)(int, const void*, size_t);
+
+static int calls = 0;
+
+static ssize_t hooked_write(int fd, const void* buf, size_t n) {
+    calls++;
+    return original_write(fd, buf, n);
+}
+
+int main(void) {
+    int fd;
+
+    if (0 > (fd = open("/dev/null", O_WRONLY | O_CLOEXEC))) {
+        return 1;
+    }
+
+    // redirected, and the original is still reachable
+    CHECK(hook_install(HOOK_TEST_LIB, "write", (void*) hooked_write, (void**) &original_write) > 0);
+    CHECK(NULL != original_write);
+    CHECK(3 == hook_test_say(fd, "foo"));
+    CHECK(1 == calls);
+
+    // the libraries not matched are left as is
+    CHECK(3 == write(fd, "bar", 3));
+    CHECK(1 == calls);
+
+    // restored
+    CHECK(hook_uninstall(HOOK_TEST_LIB, "write") > 0);
+    CHECK(3 == hook_test_say(fd, "baz"));
+    CHECK(1 == calls);
+    CHECK(-1 == hook_uninstall(HOOK_TEST_LIB, "write"));
+
+    close(fd);
+    return 0;
+}
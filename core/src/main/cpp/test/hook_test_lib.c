@@ -0,0 +1,11 @@
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Write <code>s</code> to <code>fd</code> through the imported <code>write</code>, which is hooked by hook_test
+ */
+ssize_t hook_test_say(int fd, const char* s);
+
+ssize_t hook_test_say(int fd, const char* s) {
+    return write(fd, s, strlen(s));
+}
@@ -0,0 +1,46 @@
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "linker.h"
+
+#define CHECK(cond) do {                                            \
+    if (!(cond)) {                                                  \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);  \
+        return 1;                                                   \
+    }                                                               \
+} while (0)
+
+int main(int argc, char** argv) {
+    shared_library_t* lib;
+    const char* name = NULL;
+    uintptr_t offset = 0;
+    uintptr_t address;
+    void* handle;
+
+    // the library is loaded by path, otherwise the function pointer is the PLT entry of executable
+    CHECK(argc > 1 && NULL != (handle = dlopen(argv[1], RTLD_NOW)));
+    CHECK(0 != (address = (uintptr_t) dlsym(handle, "hook_test_say")));
+    CHECK(NULL != (lib = shared_library_open(argv[1])));
+
+#if defined(__arm__)
+    // the Thumb bit of function pointers isn't a part of the address
+    address &= ~(uintptr_t) 1;
+#endif
+
+    CHECK(0 == shared_library_symbolize(lib, address, &name, &offset));
+    CHECK(0 == strcmp("hook_test_say", name));
+    CHECK(0 == offset);
+
+    CHECK(0 == shared_library_symbolize(lib, address + 2, &name, &offset));
+    CHECK(0 == strcmp("hook_test_say", name));
+    CHECK(2 == offset);
+
+    // before the image
+    CHECK(0 != shared_library_symbolize(lib, 16, &name, &offset));
+
+    shared_library_close(&lib);
+    dlclose(handle);
+    return 0;
+}